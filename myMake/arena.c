@@ -0,0 +1,70 @@
+// arena.c
+// Bump allocator for what the graph owns besides its arrays: recipe lists
+// (CommandNode and the CommandPart pieces of lines with automatic
+// variables) and the names that do not live in the mapped makefile, such as
+// pattern and depfile prerequisites. Nodes and edges are in the Graph's own
+// arrays. Everything is carved out of large blocks and released together,
+// so a million recipe lines cost a few hundred mallocs instead of millions,
+// and tearing them down costs one pass over the block list. trace.c keeps
+// span names in an arena of its own.
+#include "graph.h"
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 16
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t size;
+    _Alignas(ARENA_ALIGNMENT) char data[];
+} ArenaBlock;
+
+Arena graphArena;
+
+void* arenaAlloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    ArenaBlock* block = arena->head;
+    if (block == NULL || block->used + size > block->size) {
+        // Oversized requests get a block of their own
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + blockSize);
+        if (!block) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        block->used = 0;
+        block->size = blockSize;
+        block->next = arena->head;
+        arena->head = block;
+        arena->reservedBytes += sizeof(ArenaBlock) + blockSize;
+        if (arena->reservedBytes > arena->peakBytes) {
+            arena->peakBytes = arena->reservedBytes;
+        }
+    }
+
+    void* memory = block->data + block->used;
+    block->used += size;
+    arena->allocations++;
+    arena->usedBytes += size;
+    return memory;
+}
+
+char* arenaStrdup(Arena* arena, const char* s) {
+    size_t length = strlen(s) + 1;
+    char* copy = (char*)arenaAlloc(arena, length);
+    memcpy(copy, s, length);
+    return copy;
+}
+
+void arenaRelease(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    // The counters survive so -d can still report them after the graph is gone
+    arena->head = NULL;
+    arena->reservedBytes = 0;
+}
@@ -0,0 +1,218 @@
+// artifacts.c
+// Content-addressed artifact cache (--cache=DIR). The key of a target is its
+// -H signature: the target name, its recipe text and the content hashes of
+// its prerequisites. After a recipe succeeds the output file is copied into
+// DIR/<first two hex digits>/<key>; the next time a target with the same
+// key is out of date, that file is copied back instead of running the
+// recipe. Copies are reflinks where the filesystem supports them, so
+// switching branches back and forth costs clones, not recompiles.
+//
+// Entries are copies, never links: an output and its cache entry don't
+// share an inode, so a recipe or tool that writes the output in place
+// can't change the cached copy.
+//
+// Eviction is LRU by mtime: a hit sets the entry's mtime to now, which also
+// makes the restored target newer than its prerequisites. When the run ends,
+// if anything was stored, the oldest entries are removed until the cache
+// fits in its size limit.
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "graph.h"
+
+#ifdef __linux__
+#include <linux/fs.h>   // FICLONE
+#endif
+
+int useArtifactCache = 0;
+long artifactHits = 0;
+long artifactMisses = 0;
+
+static const char* cacheDirectory = NULL;
+static long long cacheLimit = 0;
+static int storedArtifacts = 0;
+
+typedef struct CacheEntry {
+    char* path;
+    time_t mtime;
+    long long size;
+} CacheEntry;
+
+void openArtifactCache(const char* directory, long long maxBytes) {
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create artifact cache %s.\n", directory);
+        exitWithError();
+    }
+    cacheDirectory = directory;
+    cacheLimit = maxBytes;
+    useArtifactCache = 1;
+}
+
+static void entryPath(uint64_t key, char* path, size_t size, int withDirectory) {
+    if (withDirectory) {
+        snprintf(path, size, "%s/%02x/%016llx", cacheDirectory, (unsigned)(key >> 56), (unsigned long long)key);
+    }
+    else {
+        snprintf(path, size, "%s/%02x", cacheDirectory, (unsigned)(key >> 56));
+    }
+}
+
+// Copies a file, as a reflink where the filesystem supports it
+static int copyFile(const char* from, const char* to) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    struct stat info;
+    fstat(in, &info);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, info.st_mode & 0777);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    int ok = 0;
+#ifdef FICLONE
+    ok = ioctl(out, FICLONE, in) == 0;
+#endif
+    char buffer[65536];
+    ssize_t got = 0;
+    while (!ok && (got = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, got) != got) {
+            got = -1;
+            break;
+        }
+    }
+    ok = ok || got == 0;
+    close(in);
+    ok = close(out) == 0 && ok;
+    if (!ok) {
+        unlink(to);
+    }
+    return ok ? 0 : -1;
+}
+
+// Brings back the target's output if the cache has it. Returns 1 on a hit.
+int restoreArtifact(Graph* graph, int target) {
+    GraphNode* node = &graph->nodes[target];
+    char path[4096];
+    entryPath(computeSignature(graph, target), path, sizeof(path), 1);
+
+    struct stat info;
+    if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+        artifactMisses++;
+        return 0;
+    }
+    unlink(node->name);
+    if (copyFile(path, node->name) != 0) {
+        artifactMisses++;
+        return 0;
+    }
+    // Mark it recently used, which also makes the target newer than its inputs
+    utimensat(AT_FDCWD, path, NULL, 0);
+    utimensat(AT_FDCWD, node->name, NULL, 0);
+    artifactHits++;
+    printf("Restored %s from the artifact cache\n", node->name);
+    return 1;
+}
+
+// Saves the output of a target that was just built. node->signature must
+// still hold the key computed before its recipe ran.
+void storeArtifact(GraphNode* node) {
+    struct stat info;
+    if (stat(node->name, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return;  // Nothing to keep, e.g. a phony target
+    }
+    char path[4096], temporary[4200];
+    entryPath(node->signature, path, sizeof(path), 0);
+    mkdir(path, 0755);
+    entryPath(node->signature, path, sizeof(path), 1);
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid());
+
+    // Copy under a temporary name, then rename, so readers never see a partial copy
+    if (copyFile(node->name, temporary) == 0 && rename(temporary, path) == 0) {
+        storedArtifacts++;
+    }
+    else {
+        unlink(temporary);
+    }
+}
+
+static int compareEntries(const void* a, const void* b) {
+    time_t left = ((const CacheEntry*)a)->mtime, right = ((const CacheEntry*)b)->mtime;
+    return (left > right) - (left < right);
+}
+
+// Removes the least recently used entries until the cache fits its limit
+static void evictArtifacts() {
+    CacheEntry* entries = NULL;
+    size_t count = 0, capacity = 0;
+    long long total = 0;
+    char path[4096];
+
+    DIR* top = opendir(cacheDirectory);
+    if (!top) {
+        return;
+    }
+    struct dirent* bucket;
+    while ((bucket = readdir(top)) != NULL) {
+        if (bucket->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", cacheDirectory, bucket->d_name);
+        DIR* inner = opendir(path);
+        if (!inner) {
+            continue;
+        }
+        struct dirent* file;
+        while ((file = readdir(inner)) != NULL) {
+            if (file->d_name[0] == '.') {
+                continue;
+            }
+            char entry[4400];
+            snprintf(entry, sizeof(entry), "%s/%s", path, file->d_name);
+            struct stat info;
+            if (stat(entry, &info) != 0) {
+                continue;
+            }
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 256;
+                entries = (CacheEntry*)realloc(entries, capacity * sizeof(CacheEntry));
+                if (!entries) {
+                    fprintf(stderr, "Failed to allocate memory for the graph.\n");
+                    exitWithError();
+                }
+            }
+            entries[count].path = strdup(entry);
+            if (!entries[count].path) {
+                fprintf(stderr, "Failed to allocate memory for the graph.\n");
+                exitWithError();
+            }
+            entries[count].mtime = info.st_mtime;
+            entries[count].size = (long long)info.st_blocks * 512;
+            total += entries[count].size;
+            count++;
+        }
+        closedir(inner);
+    }
+    closedir(top);
+
+    qsort(entries, count, sizeof(CacheEntry), compareEntries);
+    for (size_t i = 0; i < count; i++) {
+        if (total > cacheLimit) {
+            unlink(entries[i].path);
+            total -= entries[i].size;
+        }
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+void closeArtifactCache() {
+    if (useArtifactCache && storedArtifacts > 0) {
+        evictArtifacts();
+    }
+    storedArtifacts = 0;
+    useArtifactCache = 0;
+}
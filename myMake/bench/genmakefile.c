@@ -0,0 +1,23 @@
+// genmakefile.c
+// Writes a synthetic myMakefile to stdout:
+//   genmakefile <chain|fanout|fanin|random|diamond> <nodes> [seed]
+#include <stdlib.h>
+#include <string.h>
+#include "shapes.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || atol(argv[2]) < 1) {
+        fprintf(stderr, "Usage: %s <shape> <nodes> [seed]\nShapes:", argv[0]);
+        for (int i = 0; shapeNames[i] != NULL; i++) {
+            fprintf(stderr, " %s", shapeNames[i]);
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    unsigned seed = argc > 3 ? (unsigned)atol(argv[3]) : 1;
+    if (!writeShape(stdout, argv[1], atol(argv[2]), seed)) {
+        fprintf(stderr, "Unknown shape %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+// graph_bench.c
+// Times the phases of a build on every generated shape at several sizes:
+//   parse     readInputFromFile
+//   resolve   finalizeGraph, the cycle check and the build order
+//   noop      a build where every file exists and is up to date
+//   dispatch  a build where every target has to run its recipe
+//
+// Results go to stdout as one JSON object per line, so runs from different
+// commits can be appended to one file and compared. Progress goes to stderr.
+// Dispatch pays for one process per target, so it only runs up to
+// MAX_DISPATCH_NODES; it is reported as null above that.
+//
+//   graph_bench [--label name] [--dispatch-limit n] [sizes...]
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "graph.h"
+#include "shapes.h"
+
+#define MAX_DISPATCH_NODES 10000
+
+char clean[1024];
+Graph* tree;
+
+void exitWithError() {
+    exit(1);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void resetBuildState(Graph* graph) {
+    for (int id = 0; id < graph->numNodes; id++) {
+        graph->nodes[id].state = NODE_UNVISITED;
+    }
+    freeStatCache();
+}
+
+static void touchFile(const char* path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create %s\n", path);
+        exit(1);
+    }
+    close(fd);
+}
+
+// Runs a serial build of goal with the recipe echo sent to /dev/null
+static double timeBuild(Graph* graph, int goal) {
+    fflush(stdout);
+    int savedStdout = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+
+    double start = now();
+    printSubtree(graph, goal);
+    double elapsed = now() - start;
+
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+    return elapsed;
+}
+
+static void report(const char* label, const char* shape, Graph* graph, const char* phase, double seconds) {
+    printf("{\"label\":\"%s\",\"shape\":\"%s\",\"nodes\":%d,\"edges\":%d,\"phase\":\"%s\",",
+        label, shape, graph->numNodes, graph->numEdges, phase);
+    if (seconds < 0) {
+        printf("\"seconds\":null,\"ns_per_node\":null}\n");
+    }
+    else {
+        printf("\"seconds\":%.6f,\"ns_per_node\":%.1f}\n", seconds, seconds * 1e9 / graph->numNodes);
+    }
+    fflush(stdout);
+}
+
+static void runShape(const char* label, const char* shape, long nodes, long dispatchLimit) {
+    FILE* file = fopen("myMakefile", "w");
+    if (!file) {
+        fprintf(stderr, "Could not open file myMakefile for writing.\n");
+        exit(1);
+    }
+    writeShape(file, shape, nodes, 1);
+    fclose(file);
+    fprintf(stderr, "%s %ld\n", shape, nodes);
+
+    Graph graph;
+    initGraph(&graph);
+    tree = &graph;
+
+    double start = now();
+    char* goalName = readInputFromFile("myMakefile", &graph, 0);
+    report(label, shape, &graph, "parse", now() - start);
+
+    int* order = (int*)malloc(graph.numNodes * sizeof(int));
+    start = now();
+    finalizeGraph(&graph);
+    if (reportCycles(&graph, NULL) > 0) {
+        exit(1);
+    }
+    int goal = lookupNode(&graph, goalName);
+    int count = buildOrder(&graph, goal, order);
+    report(label, shape, &graph, "resolve", now() - start);
+
+    // Create every file prerequisites first, so each one is at least as new as what it depends on
+    for (int i = 0; i < count; i++) {
+        touchFile(graph.nodes[order[i]].name);
+    }
+    resetBuildState(&graph);
+    report(label, shape, &graph, "noop", timeBuild(&graph, goal));
+
+    if (graph.numNodes <= dispatchLimit) {
+        // Remove every target but keep the source files, then build everything
+        for (int i = 0; i < count; i++) {
+            if (graph.nodes[order[i]].commands) {
+                unlink(graph.nodes[order[i]].name);
+            }
+        }
+        resetBuildState(&graph);
+        report(label, shape, &graph, "dispatch", timeBuild(&graph, goal));
+    }
+    else {
+        report(label, shape, &graph, "dispatch", -1);
+    }
+
+    for (int i = 0; i < count; i++) {
+        unlink(graph.nodes[order[i]].name);
+    }
+    unlink("myMakefile");
+    free(order);
+    freeGraph(&graph);
+    freeStatCache();
+    releaseMakefile();
+}
+
+int main(int argc, char* argv[]) {
+    long defaultSizes[] = { 1000, 10000, 100000, 1000000 };
+    long sizes[64];
+    int numSizes = 0;
+    const char* label = "";
+    long dispatchLimit = MAX_DISPATCH_NODES;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dispatch-limit") == 0 && i + 1 < argc) {
+            dispatchLimit = atol(argv[++i]);
+        }
+        else if (atol(argv[i]) > 0 && numSizes < 64) {
+            sizes[numSizes++] = atol(argv[i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--label name] [--dispatch-limit n] [sizes...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numSizes == 0) {
+        memcpy(sizes, defaultSizes, sizeof(defaultSizes));
+        numSizes = (int)(sizeof(defaultSizes) / sizeof(defaultSizes[0]));
+    }
+
+    // Work in a scratch directory so the generated files don't land in the tree
+    char directory[] = "/tmp/graph_bench.XXXXXX";
+    char home[4096];
+    if (!getcwd(home, sizeof(home)) || !mkdtemp(directory) || chdir(directory) != 0) {
+        fprintf(stderr, "Could not set up a scratch directory.\n");
+        return 1;
+    }
+    for (int s = 0; shapeNames[s] != NULL; s++) {
+        for (int i = 0; i < numSizes; i++) {
+            runShape(label, shapeNames[s], sizes[i], dispatchLimit);
+        }
+    }
+    if (chdir(home) != 0 || rmdir(directory) != 0) {
+        fprintf(stderr, "Could not remove %s\n", directory);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+// parse_bench.c
+// Times readInputFromFile and finalizeGraph on generated makefiles of
+// growing size. Every target depends on two fresh targets (a binary tree
+// written top-down), so each rule does a constant amount of graph work and
+// any growth in ns/target comes from the name lookups.
+//
+// Given a makefile as argument, times parsing that file instead.
+#include <time.h>
+#include "graph.h"
+
+char clean[1024];
+Graph* tree;
+
+void exitWithError() {
+    exit(1);
+}
+
+static void writeMakefile(const char* path, long targets) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open file %s for writing.\n", path);
+        exit(1);
+    }
+    for (long i = 0; 2 * i + 2 < targets; i++) {
+        fprintf(file, "t%ld: t%ld t%ld\n\ttouch t%ld\n", i, 2 * i + 1, 2 * i + 2, i);
+    }
+    fclose(file);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double timeParse(char* path) {
+    Graph graph;
+    initGraph(&graph);
+    tree = &graph;
+
+    double start = now();
+    readInputFromFile(path, &graph, 1);
+    finalizeGraph(&graph);
+    double elapsed = now() - start;
+
+    freeGraph(&graph);
+    releaseMakefile();
+    return elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    long sizes[] = { 1000, 10000, 100000, 1000000 };
+    char* path = "parse_bench.mk";
+
+    if (argc > 1) {
+        printf("%s: %.4f seconds\n", argv[1], timeParse(argv[1]));
+        return 0;
+    }
+
+    printf("%10s %12s %12s\n", "targets", "seconds", "ns/target");
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        writeMakefile(path, sizes[i]);
+        double elapsed = timeParse(path);
+        printf("%10ld %12.4f %12.1f\n", sizes[i], elapsed, elapsed * 1e9 / sizes[i]);
+    }
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,146 @@
+// paths_bench.c
+// Compares contraction-hierarchy queries with plain Dijkstra on the
+// road-like grids of roads.c. For every size it times
+//   dijkstra     QUERY_DIJKSTRA, each query from a different random source
+//   preprocess   buildHierarchy, once
+//   hierarchy    QUERY_HIERARCHY on the same queries
+//   pool         the same again through a QueryPool of --threads threads,
+//                batches, names and all, as shortestPaths -c -t answers them
+// and exits with status 1 if any of them ever disagree.
+//
+// Results go to stdout as one JSON object per line, like graph_bench, so
+// runs from different commits can be appended to one file and compared.
+//
+//   paths_bench [--label name] [--queries n] [--threads n] [sides...]
+#include <time.h>
+#include "roads.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* label, Graph* g, int numEdges, const char* phase,
+    double seconds, int queries, long settled) {
+    printf("{\"label\":\"%s\",\"vertices\":%d,\"edges\":%d,\"phase\":\"%s\",\"seconds\":%.6f,",
+        label, g->numVertices, numEdges, phase, seconds);
+    if (queries > 0) {
+        printf("\"us_per_query\":%.1f,\"settled_per_query\":%.1f}\n",
+            seconds * 1e6 / queries, (double)settled / queries);
+    }
+    else {
+        printf("\"us_per_query\":null,\"settled_per_query\":null}\n");
+    }
+    fflush(stdout);
+}
+
+// Returns 1 if the hierarchy gave the same answer as Dijkstra every time
+static int benchSize(const char* label, int side, int numQueries, int threads) {
+    int numEdges;
+    Graph* g = generateGrid(side, &numEdges);
+    int n = g->numVertices;
+    int* starts = (int*)malloc(numQueries * sizeof(int));
+    int* ends = (int*)malloc(numQueries * sizeof(int));
+    int* expected = (int*)malloc(numQueries * sizeof(int));
+    for (int i = 0; i < numQueries; i++) {
+        starts[i] = nextRandom() % n;
+        ends[i] = nextRandom() % n;
+    }
+    fprintf(stderr, "%d vertices\n", n);
+
+    QueryEngine* q = initQueryEngine(g, QUERY_DIJKSTRA);
+    double start = now();
+    for (int i = 0; i < numQueries; i++) {
+        q->queries++;  // Keeps the source cache's LRU order, as shortestDistance does
+        expected[i] = dijkstra(q, starts[i], ends[i]);
+    }
+    report(label, g, numEdges, "dijkstra", now() - start, numQueries, q->settled);
+    freeQueryEngine(q);
+
+    start = now();
+    Hierarchy* h = buildHierarchy(g);
+    report(label, g, numEdges, "preprocess", now() - start, 0, 0);
+
+    q = initQueryEngine(g, QUERY_HIERARCHY);
+    q->hierarchy = h;
+    int mismatches = 0;
+    start = now();
+    for (int i = 0; i < numQueries; i++) {
+        if (hierarchySearch(q, starts[i], ends[i]) != expected[i]) {
+            mismatches++;
+        }
+    }
+    report(label, g, numEdges, "hierarchy", now() - start, numQueries, q->settled);
+
+    QueryEngine* pooled = initQueryEngine(g, QUERY_HIERARCHY);
+    pooled->hierarchy = h;
+    QueryPool* pool = initQueryPool(pooled, threads);
+    char phase[32];
+    snprintf(phase, sizeof(phase), "pool_t%d", threads);
+    start = now();
+    for (int first = 0; first < numQueries; first += QUERY_BATCH) {
+        int count = numQueries - first < QUERY_BATCH ? numQueries - first : QUERY_BATCH;
+        for (int i = 0; i < count; i++) {
+            strcpy(pool->starts[i], vertexName(g, starts[first + i]));
+            strcpy(pool->ends[i], vertexName(g, ends[first + i]));
+        }
+        answerBatch(pool, count);
+        for (int i = 0; i < count; i++) {
+            if (pool->answers[i] != expected[first + i]) {
+                mismatches++;
+            }
+        }
+    }
+    double seconds = now() - start;
+    freeQueryPool(pool);
+    report(label, g, numEdges, phase, seconds, numQueries, pooled->settled);
+    if (mismatches > 0) {
+        fprintf(stderr, "%d hierarchy answers differ from dijkstra\n", mismatches);
+    }
+    freeQueryEngine(pooled);
+    freeQueryEngine(q);
+    freeHierarchy(h);
+    freeGraph(g);
+    free(starts);
+    free(ends);
+    free(expected);
+    return mismatches == 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* label = "";
+    int numQueries = 100;
+    int threads = 2;
+    int sides[64];
+    int numSides = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        }
+        else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            numQueries = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            threads = atoi(argv[++i]);
+        }
+        else if (atoi(argv[i]) > 1 && numSides < 64) {
+            sides[numSides++] = atoi(argv[i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--label name] [--queries n] [--threads n] [sides...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numSides == 0) {
+        sides[numSides++] = 100;  // 10k vertices
+        sides[numSides++] = 316;  // 100k
+    }
+
+    int ok = 1;
+    for (int i = 0; i < numSides; i++) {
+        ok &= benchSize(label, sides[i], numQueries, threads);
+    }
+    return ok ? 0 : 1;
+}
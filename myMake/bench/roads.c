@@ -0,0 +1,58 @@
+// roads.c
+// Graph generators for the shortestPaths benchmarks. Both build the graph
+// through addVertex and addEdge, exactly as readGraphFromFile does.
+#include "roads.h"
+
+static unsigned long long rngState = 88172645463325252ULL;
+
+void seedRoads(unsigned long long seed) {
+    rngState = seed ? seed : 88172645463325252ULL;  // xorshift must not start at 0
+}
+
+unsigned int nextRandom() {
+    rngState ^= rngState << 13;  // xorshift64
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return (unsigned int)(rngState >> 32);
+}
+
+Graph* generateGrid(int side, int* numEdges) {
+    Graph* g = initGraph();
+    char name[32];
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            snprintf(name, sizeof(name), "v%d_%d", r, c);
+            addVertex(g, name);  // Vertex r * side + c
+        }
+    }
+    *numEdges = 0;
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            int id = r * side + c;
+            if (c + 1 < side && nextRandom() % 10 != 0) {
+                addEdge(g, id, id + 1, 1 + nextRandom() % 100);
+                (*numEdges)++;
+            }
+            if (r + 1 < side && nextRandom() % 10 != 0) {
+                addEdge(g, id, id + side, 1 + nextRandom() % 100);
+                (*numEdges)++;
+            }
+        }
+    }
+    finalizeGraph(g);
+    return g;
+}
+
+Graph* generateRandomGraph(int numVertices, int numEdges, int maxLength) {
+    Graph* g = initGraph();
+    char name[32];
+    for (int i = 0; i < numVertices; i++) {
+        snprintf(name, sizeof(name), "n%d", i);
+        addVertex(g, name);
+    }
+    for (int i = 0; i < numEdges; i++) {
+        addEdge(g, nextRandom() % numVertices, nextRandom() % numVertices, 1 + nextRandom() % maxLength);
+    }
+    finalizeGraph(g);
+    return g;
+}
@@ -0,0 +1,25 @@
+// roads.h
+// Synthetic graphs for shortestPaths, shared by paths_bench and sssp_bench.
+#ifndef ROADS_H
+#define ROADS_H
+
+#include "shortestPaths.h"
+
+// Seeds the generator; the same seed gives the same graphs and numbers
+void seedRoads(unsigned long long seed);
+
+// A uniform random number from the generator
+unsigned int nextRandom();
+
+// Road-like grid of side x side vertices named v<row>_<column>, vertex
+// r * side + c, each joined to its right and lower neighbour with
+// probability 0.9 by an edge of length 1 to 100. Finalized. Sets
+// *numEdges to the number of undirected edges.
+Graph* generateGrid(int side, int* numEdges);
+
+// numVertices vertices named n<i> and numEdges random edges of length 1 to
+// maxLength, self-loops and parallel edges included, so the graph is
+// usually disconnected when numEdges is small. Finalized.
+Graph* generateRandomGraph(int numVertices, int numEdges, int maxLength);
+
+#endif // ROADS_H
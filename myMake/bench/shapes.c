@@ -0,0 +1,151 @@
+// shapes.c
+// The shapes, for n nodes:
+//   chain    t0 -> t1 -> ... -> t(n-1), one level per node
+//   fanout   t0 depends directly on all the other n-1 nodes
+//   fanin    t0 depends on t1..t(n-2), which all depend on t(n-1)
+//   random   random DAG: a random spanning tree from t0 plus two extra
+//            edges per node, always towards higher ids so there is no cycle
+//   diamond  w*w lattice with w = sqrt(n), each cell depends on the cell
+//            below and the cell to its right
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shapes.h"
+
+const char* shapeNames[] = { "chain", "fanout", "fanin", "random", "diamond", NULL };
+
+static void writeRecipe(FILE* file, long target) {
+    fprintf(file, "\n\ttouch t%ld\n", target);
+}
+
+static void writeChain(FILE* file, long n) {
+    for (long i = 0; i + 1 < n; i++) {
+        fprintf(file, "t%ld: t%ld", i, i + 1);
+        writeRecipe(file, i);
+    }
+}
+
+static void writeFanOut(FILE* file, long n) {
+    fprintf(file, "t0:");
+    for (long i = 1; i < n; i++) {
+        fprintf(file, " t%ld", i);
+    }
+    writeRecipe(file, 0);
+}
+
+static void writeFanIn(FILE* file, long n) {
+    if (n < 3) {
+        writeChain(file, n);
+        return;
+    }
+    fprintf(file, "t0:");
+    for (long i = 1; i < n - 1; i++) {
+        fprintf(file, " t%ld", i);
+    }
+    writeRecipe(file, 0);
+    for (long i = 1; i < n - 1; i++) {
+        fprintf(file, "t%ld: t%ld", i, n - 1);
+        writeRecipe(file, i);
+    }
+}
+
+// Small LCG so a seed gives the same graph on every platform
+static unsigned long long randomState;
+
+static long nextRandom(long bound) {
+    randomState = randomState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (long)((randomState >> 33) % (unsigned long long)bound);
+}
+
+static void writeRandom(FILE* file, long n, unsigned seed) {
+    randomState = seed;
+
+    // Node i > 0 hangs off a random earlier node, so t0 reaches everything
+    long* parent = (long*)malloc(n * sizeof(long));
+    long* start = (long*)calloc(n + 1, sizeof(long));
+    long* children = (long*)malloc(n * sizeof(long));
+    for (long i = 1; i < n; i++) {
+        parent[i] = nextRandom(i);
+        start[parent[i] + 1]++;
+    }
+    for (long i = 0; i < n; i++) {
+        start[i + 1] += start[i];
+    }
+    long* next = (long*)malloc((n + 1) * sizeof(long));
+    for (long i = 0; i <= n; i++) {
+        next[i] = start[i];
+    }
+    for (long i = 1; i < n; i++) {
+        children[next[parent[i]]++] = i;
+    }
+
+    for (long i = 0; i < n; i++) {
+        int extra = (i + 2 < n) ? 2 : 0;
+        if (start[i] == start[i + 1] && extra == 0) {
+            continue;  // Leaf, a source file
+        }
+        fprintf(file, "t%ld:", i);
+        for (long c = start[i]; c < start[i + 1]; c++) {
+            fprintf(file, " t%ld", children[c]);
+        }
+        // Extra edges point further down, and never at a node already listed
+        long previous = -1;
+        for (int e = 0; e < extra; e++) {
+            long target = i + 1 + nextRandom(n - i - 1);
+            if (parent[target] != i && target != previous) {
+                fprintf(file, " t%ld", target);
+                previous = target;
+            }
+        }
+        writeRecipe(file, i);
+    }
+    free(parent);
+    free(start);
+    free(children);
+    free(next);
+}
+
+static void writeDiamond(FILE* file, long n) {
+    long width = (long)sqrt((double)n);
+    if (width < 1) {
+        width = 1;
+    }
+    for (long row = 0; row < width; row++) {
+        for (long column = 0; column < width; column++) {
+            long id = row * width + column;
+            if (row + 1 == width && column + 1 == width) {
+                continue;  // Bottom right corner is the only source file
+            }
+            fprintf(file, "t%ld:", id);
+            if (row + 1 < width) {
+                fprintf(file, " t%ld", id + width);
+            }
+            if (column + 1 < width) {
+                fprintf(file, " t%ld", id + 1);
+            }
+            writeRecipe(file, id);
+        }
+    }
+}
+
+int writeShape(FILE* file, const char* shape, long nodes, unsigned seed) {
+    if (strcmp(shape, "chain") == 0) {
+        writeChain(file, nodes);
+    }
+    else if (strcmp(shape, "fanout") == 0) {
+        writeFanOut(file, nodes);
+    }
+    else if (strcmp(shape, "fanin") == 0) {
+        writeFanIn(file, nodes);
+    }
+    else if (strcmp(shape, "random") == 0) {
+        writeRandom(file, nodes, seed);
+    }
+    else if (strcmp(shape, "diamond") == 0) {
+        writeDiamond(file, nodes);
+    }
+    else {
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,17 @@
+// shapes.h
+// Synthetic myMakefile generator shared by genmakefile and graph_bench.
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include <stdio.h>
+
+// Shape names accepted by writeShape, NULL terminated
+extern const char* shapeNames[];
+
+// Writes a makefile of about `nodes` targets in the given shape to file.
+// Targets are named t0, t1, ... and t0 is always the first rule, so it is
+// the default goal. Nodes without a rule are plain source files. Every rule
+// has a single "touch <target>" recipe line. Returns 0 for an unknown shape.
+int writeShape(FILE* file, const char* shape, long nodes, unsigned seed);
+
+#endif // SHAPES_H
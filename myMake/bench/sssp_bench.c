@@ -0,0 +1,205 @@
+// sssp_bench.c
+// Times delta-stepping against plain Dijkstra for single-source shortest
+// paths to every vertex of the road-like grids of roads.c. For every size
+// it times
+//   dijkstra     dijkstraAll, one thread
+//   delta_tN     deltaStepping on N threads, for each N in --threads
+// from the same few random sources, and exits with status 1 if any
+// distance ever differs from Dijkstra's.
+//
+// --check runs the differential test instead: small random graphs, with
+// self-loops, parallel edges and unreachable vertices, and one edge of a
+// billion, through a spread of deltas and thread counts, every distance
+// compared with dijkstraAll.
+//
+// Results go to stdout as one JSON object per line, like paths_bench, so
+// runs from different commits can be appended to one file and compared.
+//
+//   sssp_bench [--label name] [--sources n] [--delta d] [--threads 1,2,4,8] [sides...]
+//   sssp_bench --check
+#include <time.h>
+#include "roads.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* label, Graph* g, int numEdges, const char* phase,
+    double seconds, int sources, int delta, long phases) {
+    printf("{\"label\":\"%s\",\"vertices\":%d,\"edges\":%d,\"phase\":\"%s\",\"seconds\":%.6f,"
+        "\"ms_per_source\":%.3f,\"delta\":%d,\"phases_per_source\":%.1f}\n",
+        label, g->numVertices, numEdges, phase, seconds, seconds * 1e3 / sources,
+        delta, (double)phases / sources);
+    fflush(stdout);
+}
+
+// Returns the number of vertices whose distances differ
+static int countMismatches(int* dist, int* expected, int n) {
+    int mismatches = 0;
+    for (int v = 0; v < n; v++) {
+        if (dist[v] != expected[v]) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+// Returns 1 if delta-stepping agreed with Dijkstra on every source and thread count
+static int benchSize(const char* label, int side, int numSources, int delta,
+    int* threadCounts, int numThreadCounts) {
+    int numEdges;
+    Graph* g = generateGrid(side, &numEdges);
+    int n = g->numVertices;
+    int* sources = (int*)malloc(numSources * sizeof(int));
+    int* expected = (int*)malloc((size_t)numSources * n * sizeof(int));
+    int* dist = (int*)malloc(n * sizeof(int));
+    for (int i = 0; i < numSources; i++) {
+        sources[i] = nextRandom() % n;
+    }
+    if (delta == 0) {
+        delta = defaultDelta(g);
+    }
+    fprintf(stderr, "%d vertices\n", n);
+
+    double start = now();
+    for (int i = 0; i < numSources; i++) {
+        dijkstraAll(g, sources[i], &expected[(size_t)i * n]);
+    }
+    report(label, g, numEdges, "dijkstra", now() - start, numSources, 0, 0);
+
+    int mismatches = 0;
+    for (int t = 0; t < numThreadCounts; t++) {
+        char phase[32];
+        snprintf(phase, sizeof(phase), "delta_t%d", threadCounts[t]);
+        double seconds = 0;
+        long phases = 0;
+        for (int i = 0; i < numSources; i++) {
+            start = now();
+            phases += deltaStepping(g, sources[i], delta, threadCounts[t], dist);
+            seconds += now() - start;  // Leaves the comparison out
+            mismatches += countMismatches(dist, &expected[(size_t)i * n], n);
+        }
+        report(label, g, numEdges, phase, seconds, numSources, delta, phases);
+    }
+    if (mismatches > 0) {
+        fprintf(stderr, "%d delta-stepping distances differ from dijkstra\n", mismatches);
+    }
+    freeGraph(g);
+    free(sources);
+    free(expected);
+    free(dist);
+    return mismatches == 0;
+}
+
+// Runs delta-stepping from source on g with every delta and thread count
+// of the check. Returns the number of runs that differ from Dijkstra.
+static int checkGraph(Graph* g, int source, const char* name, int* runs) {
+    static const int deltas[] = { 1, 7, 100, 5000 };
+    static const int threadCounts[] = { 1, 2, 3, 8 };
+    int n = g->numVertices;
+    int* expected = (int*)malloc(n * sizeof(int));
+    int* dist = (int*)malloc(n * sizeof(int));
+    int failures = 0;
+    dijkstraAll(g, source, expected);
+    for (int d = 0; d < (int)(sizeof(deltas) / sizeof(deltas[0])); d++) {
+        for (int t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); t++) {
+            deltaStepping(g, source, deltas[d], threadCounts[t], dist);
+            int mismatches = countMismatches(dist, expected, n);
+            if (mismatches > 0) {
+                fprintf(stderr, "%s (%d vertices, %d edge entries), delta %d, %d threads: %d distances differ\n",
+                    name, n, g->numEdges, deltas[d], threadCounts[t], mismatches);
+                failures++;
+            }
+            (*runs)++;
+        }
+    }
+    free(expected);
+    free(dist);
+    return failures;
+}
+
+// Returns 1 if every graph, delta and thread count gave Dijkstra's distances
+static int checkDifferential() {
+    static const int maxLengths[] = { 1000, 10, 1000000 };
+    int runs = 0;
+    int failures = 0;
+    char name[32];
+    for (int graph = 0; graph < 200; graph++) {
+        // Sparse to dense, short edges to long, so that some graphs are all
+        // light edges and some all heavy for the same delta, and some have
+        // edges far longer than the buckets a thread keeps
+        int numVertices = 1 + nextRandom() % 300;
+        int numEdges = nextRandom() % (numVertices * 4 + 1);
+        Graph* g = generateRandomGraph(numVertices, numEdges, maxLengths[graph % 3]);
+        snprintf(name, sizeof(name), "graph %d", graph);
+        failures += checkGraph(g, nextRandom() % numVertices, name, &runs);
+        freeGraph(g);
+    }
+
+    // One edge of a billion: buckets of width 1 must not be kept up to its end
+    Graph* g = initGraph();
+    addVertex(g, "a");
+    addVertex(g, "b");
+    addVertex(g, "c");
+    addEdge(g, 0, 1, 1000000000);
+    addEdge(g, 1, 2, 1);
+    finalizeGraph(g);
+    failures += checkGraph(g, 0, "long edge", &runs);
+    freeGraph(g);
+
+    fprintf(stderr, "%d runs, %d differ from dijkstra\n", runs, failures);
+    return failures == 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* label = "";
+    int numSources = 5;
+    int delta = 0;  // defaultDelta
+    int threadCounts[64] = { 1, 2, 4, 8 };
+    int numThreadCounts = 4;
+    int sides[64];
+    int numSides = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            return checkDifferential() ? 0 : 1;
+        }
+        else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sources") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            numSources = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--delta") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            delta = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            numThreadCounts = 0;
+            for (char* count = strtok(argv[++i], ","); count && numThreadCounts < 64; count = strtok(NULL, ",")) {
+                if (atoi(count) > 0) {
+                    threadCounts[numThreadCounts++] = atoi(count);
+                }
+            }
+        }
+        else if (atoi(argv[i]) > 1 && numSides < 64) {
+            sides[numSides++] = atoi(argv[i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--label name] [--sources n] [--delta d] [--threads 1,2,4,8] [sides...] | --check\n",
+                argv[0]);
+            return 1;
+        }
+    }
+    if (numSides == 0) {
+        sides[numSides++] = 316;   // 100k vertices
+        sides[numSides++] = 1000;  // 1M
+    }
+
+    int ok = 1;
+    for (int i = 0; i < numSides; i++) {
+        ok &= benchSize(label, sides[i], numSources, delta, threadCounts, numThreadCounts);
+    }
+    return ok ? 0 : 1;
+}
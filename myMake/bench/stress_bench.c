@@ -0,0 +1,137 @@
+// stress_bench.c
+// Parses, finalizes, checks for cycles and orders generated makefiles of
+// two extreme shapes: a chain where every target depends on the next one,
+// and a single target that depends on every other one. The traversal runs on a thread with a
+// deliberately small stack, so anything that recurses per level or per
+// sibling crashes here instead of in a user's build.
+//
+// Exits with status 1 if ns/target at the largest size is more than
+// LINEAR_SLACK times the smallest one, i.e. if some step stopped being linear.
+#include <pthread.h>
+#include <time.h>
+#include "graph.h"
+
+#define TRAVERSAL_STACK (256 * 1024)
+#define LINEAR_SLACK 4.0
+
+char clean[1024];
+Graph* tree;
+
+void exitWithError() {
+    exit(1);
+}
+
+static void writeChain(const char* path, long targets) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open file %s for writing.\n", path);
+        exit(1);
+    }
+    for (long i = 0; i + 1 < targets; i++) {
+        fprintf(file, "t%ld: t%ld\n\ttouch t%ld\n", i, i + 1, i);
+    }
+    fclose(file);
+}
+
+static void writeFanOut(const char* path, long targets) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open file %s for writing.\n", path);
+        exit(1);
+    }
+    fprintf(file, "t0:");
+    for (long i = 1; i < targets; i++) {
+        fprintf(file, " t%ld", i);
+    }
+    fprintf(file, "\n\ttouch t0\n");
+    fclose(file);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct Run {
+    char* path;
+    long ordered;
+    double seconds;
+} Run;
+
+static void* runTraversal(void* argument) {
+    Run* run = (Run*)argument;
+    Graph graph;
+    initGraph(&graph);
+    tree = &graph;
+
+    double start = now();
+    char* goal = readInputFromFile(run->path, &graph, 0);
+    finalizeGraph(&graph);
+    if (reportCycles(&graph, NULL) > 0) {
+        exit(1);
+    }
+    int* order = (int*)malloc(graph.numNodes * sizeof(int));
+    run->ordered = buildOrder(&graph, lookupNode(&graph, goal), order);
+    run->seconds = now() - start;
+
+    free(order);
+    freeGraph(&graph);
+    releaseMakefile();
+    return NULL;
+}
+
+// Runs one traversal on a small-stack thread and returns ns per target
+static double timeShape(char* path, long targets) {
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, TRAVERSAL_STACK);
+
+    Run run = { path, 0, 0 };
+    pthread_t thread;
+    if (pthread_create(&thread, &attributes, runTraversal, &run) != 0) {
+        fprintf(stderr, "Could not start the traversal thread.\n");
+        exit(1);
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attributes);
+
+    if (run.ordered != targets) {
+        fprintf(stderr, "%s: ordered %ld of %ld targets\n", path, run.ordered, targets);
+        exit(1);
+    }
+    printf("%10ld %12.4f %12.1f\n", targets, run.seconds, run.seconds * 1e9 / targets);
+    return run.seconds * 1e9 / targets;
+}
+
+int main() {
+    long sizes[] = { 10000, 100000, 1000000 };
+    int numSizes = (int)(sizeof(sizes) / sizeof(sizes[0]));
+    char* path = "stress_bench.mk";
+    int failed = 0;
+
+    for (int shape = 0; shape < 2; shape++) {
+        printf("%s\n", shape == 0 ? "deep chain" : "wide fan-out");
+        printf("%10s %12s %12s\n", "targets", "seconds", "ns/target");
+        double first = 0, last = 0;
+        for (int i = 0; i < numSizes; i++) {
+            if (shape == 0) {
+                writeChain(path, sizes[i]);
+            }
+            else {
+                writeFanOut(path, sizes[i]);
+            }
+            last = timeShape(path, sizes[i]);
+            if (i == 0) {
+                first = last;
+            }
+        }
+        if (last > first * LINEAR_SLACK) {
+            printf("not linear: %.1f ns/target at %ld targets, %.1f at %ld\n",
+                last, sizes[numSizes - 1], first, sizes[0]);
+            failed = 1;
+        }
+    }
+    remove(path);
+    return failed;
+}
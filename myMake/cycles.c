@@ -0,0 +1,219 @@
+// cycles.c
+// Finds every dependency cycle in the graph right after it is built, using
+// an iterative version of Tarjan's strongly connected components algorithm.
+// Each component with more than one target, or a target that lists itself,
+// is a cycle. The whole pass is O(V+E): Tarjan visits every node and edge
+// once, and the path printed for a component only searches inside it.
+//
+// Every cycle is printed, but only the ones the goal depends on count: a
+// cycle elsewhere in the makefile does not stop a build that never gets
+// there, the same as make.
+#include "graph.h"
+
+typedef struct CycleSearch {
+    int* index;       // DFS discovery number, -1 while unvisited
+    int* low;         // Smallest discovery number reachable from the node
+    int* component;   // Component number once the node's component is closed
+    char* onStack;
+    int* members;     // Tarjan's stack of nodes whose component is still open
+    int numMembers;
+    int* callNode;    // Explicit DFS stack: node and the next edge to follow
+    int* callEdge;
+    int* parent;      // Used while tracing the path of one component
+    int* queue;
+    char* isCycle;    // By component root: 1 for a cycle, 2 once it is counted
+} CycleSearch;
+
+// Prints one cycle through the component's first member, found by a BFS that
+// never leaves the component, followed by the other members if there are any
+static void printCycle(Graph* graph, CycleSearch* search, int* members, int size, int id) {
+    int start = members[0];
+    int head = 0, tail = 0, last = -1;
+    search->parent[start] = start;
+    search->queue[tail++] = start;
+    while (head < tail && last == -1) {
+        int current = search->queue[head++];
+        for (int e = graph->prereqStart[current]; e < graph->prereqStart[current + 1]; e++) {
+            int prereq = graph->prereqs[e];
+            if (search->component[prereq] != id) {
+                continue;
+            }
+            if (prereq == start) {
+                last = current;  // Closing edge back to the start
+                break;
+            }
+            if (search->parent[prereq] == -1) {
+                search->parent[prereq] = current;
+                search->queue[tail++] = prereq;
+            }
+        }
+    }
+
+    // Walk the parents back to the start, then print them the other way round
+    int length = 0;
+    for (int current = last; current != start; current = search->parent[current]) {
+        search->queue[length++] = current;
+    }
+    fprintf(stderr, "Circular dependency: %s", graph->nodes[start].name);
+    for (int i = length - 1; i >= 0; i--) {
+        fprintf(stderr, " -> %s", graph->nodes[search->queue[i]].name);
+    }
+    fprintf(stderr, " -> %s\n", graph->nodes[start].name);
+
+    if (size > length + 1) {
+        fprintf(stderr, "  targets in the same cycle:");
+        for (int i = 0; i < size; i++) {
+            fprintf(stderr, " %s", graph->nodes[members[i]].name);
+        }
+        fprintf(stderr, "\n");
+    }
+    for (int i = 0; i < size; i++) {
+        search->parent[members[i]] = -1;
+    }
+}
+
+static int hasSelfLoop(Graph* graph, int id) {
+    for (int e = graph->prereqStart[id]; e < graph->prereqStart[id + 1]; e++) {
+        if (graph->prereqs[e] == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Pops the component rooted at root off Tarjan's stack. Returns 1 if it is a cycle.
+static int closeComponent(Graph* graph, CycleSearch* search, int root) {
+    int first = search->numMembers;
+    do {
+        first--;
+        search->onStack[search->members[first]] = 0;
+        search->component[search->members[first]] = root;
+    } while (search->members[first] != root);
+
+    int* members = &search->members[first];
+    int size = search->numMembers - first;
+    search->numMembers = first;
+
+    if (size == 1 && !hasSelfLoop(graph, root)) {
+        return 0;
+    }
+    // Members were pushed in discovery order, so members[0] is the root
+    printCycle(graph, search, members, size, root);
+    search->isCycle[root] = 1;
+    return 1;
+}
+
+// Number of cycles among the nodes the goal depends on, itself included.
+// Needs the components, and onStack all clear, which Tarjan leaves it.
+static int countReachable(Graph* graph, CycleSearch* search, int goal) {
+    int head = 0, tail = 0, cycles = 0;
+    char* reached = search->onStack;
+    reached[goal] = 1;
+    search->queue[tail++] = goal;
+    while (head < tail) {
+        int current = search->queue[head++];
+        int root = search->component[current];
+        if (search->isCycle[root] == 1) {
+            search->isCycle[root] = 2;
+            cycles++;
+        }
+        for (int e = graph->prereqStart[current]; e < graph->prereqStart[current + 1]; e++) {
+            int prereq = graph->prereqs[e];
+            if (!reached[prereq]) {
+                reached[prereq] = 1;
+                search->queue[tail++] = prereq;
+            }
+        }
+    }
+    return cycles;
+}
+
+// Prints every cycle in the graph. Returns the number of them the goal
+// depends on, or all of them when goalName is NULL (the server answers for
+// any target); 0 when the goal is not in the graph.
+int reportCycles(Graph* graph, const char* goalName) {
+    int n = graph->numNodes;
+    if (n == 0) {
+        return 0;
+    }
+    CycleSearch search;
+    search.index = (int*)malloc(n * sizeof(int));
+    search.low = (int*)malloc(n * sizeof(int));
+    search.component = (int*)malloc(n * sizeof(int));
+    search.onStack = (char*)calloc(n, 1);
+    search.members = (int*)malloc(n * sizeof(int));
+    search.callNode = (int*)malloc(n * sizeof(int));
+    search.callEdge = (int*)malloc(n * sizeof(int));
+    search.parent = (int*)malloc(n * sizeof(int));
+    search.queue = (int*)malloc(n * sizeof(int));
+    search.isCycle = (char*)calloc(n, 1);
+    if (!search.index || !search.low || !search.component || !search.onStack || !search.members
+        || !search.callNode || !search.callEdge || !search.parent || !search.queue || !search.isCycle) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    memset(search.index, -1, n * sizeof(int));
+    memset(search.component, -1, n * sizeof(int));
+    memset(search.parent, -1, n * sizeof(int));
+    search.numMembers = 0;
+
+    int nextIndex = 0, cycles = 0;
+    for (int root = 0; root < n; root++) {
+        if (search.index[root] != -1) {
+            continue;
+        }
+        int depth = 0;
+        search.index[root] = search.low[root] = nextIndex++;
+        search.members[search.numMembers++] = root;
+        search.onStack[root] = 1;
+        search.callNode[depth] = root;
+        search.callEdge[depth++] = graph->prereqStart[root];
+
+        while (depth > 0) {
+            int current = search.callNode[depth - 1];
+            if (search.callEdge[depth - 1] < graph->prereqStart[current + 1]) {
+                int prereq = graph->prereqs[search.callEdge[depth - 1]++];
+                if (search.index[prereq] == -1) {
+                    search.index[prereq] = search.low[prereq] = nextIndex++;
+                    search.members[search.numMembers++] = prereq;
+                    search.onStack[prereq] = 1;
+                    search.callNode[depth] = prereq;
+                    search.callEdge[depth++] = graph->prereqStart[prereq];
+                }
+                else if (search.onStack[prereq] && search.index[prereq] < search.low[current]) {
+                    search.low[current] = search.index[prereq];
+                }
+                continue;
+            }
+
+            // Every edge followed, hand the low link back to the caller
+            depth--;
+            if (depth > 0) {
+                int caller = search.callNode[depth - 1];
+                if (search.low[current] < search.low[caller]) {
+                    search.low[caller] = search.low[current];
+                }
+            }
+            if (search.low[current] == search.index[current]) {
+                cycles += closeComponent(graph, &search, current);
+            }
+        }
+    }
+
+    if (goalName != NULL && cycles > 0) {
+        int goal = lookupNode(graph, goalName);
+        cycles = goal == -1 ? 0 : countReachable(graph, &search, goal);
+    }
+
+    free(search.index);
+    free(search.low);
+    free(search.component);
+    free(search.onStack);
+    free(search.members);
+    free(search.callNode);
+    free(search.callEdge);
+    free(search.parent);
+    free(search.queue);
+    free(search.isCycle);
+    return cycles;
+}
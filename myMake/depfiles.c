@@ -0,0 +1,231 @@
+// depfiles.c
+// Merges compiler-generated dependency files (gcc/clang -MMD) into the
+// graph. For every target with a recipe, <target minus extension>.d is read
+// if it exists, and each rule in it adds its prerequisites as edges to the
+// target it names, so headers never have to be listed in the myMakefile.
+// The rule's own target decides: foo.o, foo.out and foo.bin all lead to
+// foo.d, but only the target its rule is written for gets the headers.
+//
+// Headers that no longer exist are skipped rather than reported: the
+// depfile is stale, and the compile that depends on the change rewrites it.
+//
+// Runs after finalizeGraph, so edges already in the makefile are seen in
+// the CSR and not added twice; the graph is finalized again afterwards.
+#include <fcntl.h>
+#include <unistd.h>
+#include "graph.h"
+
+long depfilesRead = 0;
+long depfileEdges = 0;
+
+static HashMap probedPaths;     // Every depfile path looked at, found or not
+static char* fileBuffer = NULL;
+static size_t fileBufferSize = 0;
+static int* markedFor = NULL;   // Target (plus one) a node was last added to
+static int markCapacity = 0;
+
+// Reads a whole file into fileBuffer, NUL-terminated. Returns its length or -1.
+static long readWholeFile(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    long length = 0;
+    for (;;) {
+        if (length + 4096 + 1 > (long)fileBufferSize) {
+            size_t size = fileBufferSize ? fileBufferSize * 2 : 65536;
+            char* grown = (char*)realloc(fileBuffer, size);
+            if (!grown) {
+                fprintf(stderr, "Failed to allocate memory for the graph.\n");
+                close(fd);
+                exitWithError();
+            }
+            fileBuffer = grown;
+            fileBufferSize = size;
+        }
+        ssize_t got = read(fd, fileBuffer + length, fileBufferSize - length - 1);
+        if (got <= 0) {
+            break;
+        }
+        length += got;
+    }
+    close(fd);
+    fileBuffer[length] = '\0';
+    return length;
+}
+
+static void markNode(int id, int target) {
+    if (id >= markCapacity) {
+        int capacity = markCapacity ? markCapacity : 1024;
+        while (capacity <= id) {
+            capacity *= 2;
+        }
+        int* grown = (int*)realloc(markedFor, capacity * sizeof(int));
+        if (!grown) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        markedFor = grown;
+        memset(markedFor + markCapacity, 0, (capacity - markCapacity) * sizeof(int));
+        markCapacity = capacity;
+    }
+    markedFor[id] = target + 1;
+}
+
+static int isMarked(int id, int target) {
+    return id < markCapacity && markedFor[id] == target + 1;
+}
+
+static void addDepfileEdge(Graph* graph, int target, char* name) {
+    int id = lookupNode(graph, name);
+    if (id == target || (id != -1 && isMarked(id, target))) {
+        return;  // Listed already
+    }
+    struct stat info;
+    if (cachedStat(name, &info) != 0) {
+        return;  // Stale entry for a header that is gone
+    }
+    if (id == -1) {
+        id = findOrCreateNode(graph, arenaStrdup(&graphArena, name));
+    }
+    markNode(id, target);
+    addEdge(graph, target, id);
+    depfileEdges++;
+}
+
+// Reads one name of a depfile into name, undoing make's escapes: "\ " is a
+// space, "\#" a hash, "$$" a dollar sign. Blanks and backslash-newlines in
+// front of it are skipped. The name ends at a blank or the end of the line,
+// and, among a rule's targets, at the colon. Returns the position after
+// it; name is empty if the line, or the targets, ended first.
+static const char* readName(const char* p, char* name, size_t size, int targets) {
+    for (;;) {
+        if (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        else if (*p == '\\' && p[1] == '\n') {
+            p += 2;
+        }
+        else if (*p == '\\' && p[1] == '\r' && p[2] == '\n') {
+            p += 3;
+        }
+        else {
+            break;
+        }
+    }
+    size_t length = 0;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' && !(targets && *p == ':')) {
+        if (*p == '\\' && (p[1] == '\n' || p[1] == '\r')) {
+            break;
+        }
+        if ((*p == '\\' && (p[1] == ' ' || p[1] == '#' || p[1] == ':')) || (*p == '$' && p[1] == '$')) {
+            p++;
+        }
+        if (length + 1 < size) {
+            name[length++] = *p;
+        }
+        p++;
+    }
+    name[length] = '\0';
+    return p;
+}
+
+// Adds the prerequisites of every rule in a depfile to the targets the rule
+// names, when they are in the graph with a recipe of their own. Rules for
+// anything else, such as the empty ones -MP writes for headers or a rule
+// for an object this makefile does not build, add nothing.
+static void parseDepfile(Graph* graph, const char* p) {
+    char name[4096];
+    int targets[16];
+    while (*p) {
+        int numTargets = 0;
+        for (p = readName(p, name, sizeof(name), 1); name[0]; p = readName(p, name, sizeof(name), 1)) {
+            int id = lookupNode(graph, name);
+            if (id != -1 && graph->nodes[id].commands && !strchr(name, '%') && numTargets < 16) {
+                targets[numTargets++] = id;
+            }
+        }
+        if (*p == ':') {
+            const char* prereqs = p + 1;
+            for (int t = 0; t < numTargets; t++) {
+                // Prerequisites from the makefile count as listed
+                int target = targets[t];
+                for (int e = graph->prereqStart[target]; e < graph->prereqStart[target + 1]; e++) {
+                    markNode(graph->prereqs[e], target);
+                }
+                for (p = readName(prereqs, name, sizeof(name), 0); name[0]; p = readName(p, name, sizeof(name), 0)) {
+                    addDepfileEdge(graph, target, name);
+                }
+            }
+            for (p = prereqs; *p && *p != '\n'; p++) {
+                if (*p == '\\' && (p[1] == '\n' || (p[1] == '\r' && p[2] == '\n'))) {
+                    p += p[1] == '\n' ? 1 : 2;  // The rule goes on on the next line
+                }
+            }
+        }
+        while (*p && *p != '\n') {
+            p++;  // A line without a colon, or the end of the rule
+        }
+        if (*p == '\n') {
+            p++;
+        }
+    }
+}
+
+// Loads the depfiles of the targets with a recipe: <target minus
+// extension>.d, where gcc -MMD writes it, each file once however many
+// targets share its name. Returns the number of edges added; the caller
+// has to finalize the graph again if it is nonzero.
+int loadDepfiles(Graph* graph) {
+    int numTargets = graph->numNodes;  // Headers added below never have depfiles
+    long edgesBefore = depfileEdges;
+    char path[4096];
+
+    if (probedPaths.capacity == 0) {
+        hashMapInit(&probedPaths, 1024);
+    }
+    for (int target = 0; target < numTargets; target++) {
+        GraphNode* node = &graph->nodes[target];
+        const char* name = node->name;
+        const char* dot = strrchr(name, '.');
+        if (!node->commands || !dot || strchr(dot, '/') || dot == name || strchr(name, '%')) {
+            continue;
+        }
+        if (snprintf(path, sizeof(path), "%.*s.d", (int)(dot - name), name) >= (int)sizeof(path)) {
+            continue;
+        }
+        if (hashMapGet(&probedPaths, path) != NULL) {
+            continue;  // Read already, for every target it names
+        }
+        char* copy = strdup(path);
+        if (!copy) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        hashMapPut(&probedPaths, copy, copy);
+        if (readWholeFile(path) < 0) {
+            continue;
+        }
+        depfilesRead++;
+        parseDepfile(graph, fileBuffer);
+    }
+    return (int)(depfileEdges - edgesBefore);
+}
+
+// 1 if path is a depfile loadDepfiles looked for, whether it existed or not
+int isDepfile(const char* path) {
+    return probedPaths.capacity != 0 && hashMapGet(&probedPaths, path) != NULL;
+}
+
+void freeDepfiles() {
+    for (size_t i = 0; i < probedPaths.capacity; i++) {
+        free(probedPaths.entries[i].value);
+    }
+    hashMapFree(&probedPaths);
+    free(fileBuffer);
+    free(markedFor);
+    fileBuffer = NULL;
+    fileBufferSize = 0;
+    markedFor = NULL;
+    markCapacity = 0;
+}
@@ -0,0 +1,118 @@
+// executor.c
+// Runs recipe lines. A line made only of plain words is split on blanks
+// and started directly with posix_spawnp; anything the shell would have to
+// interpret (pipes, redirects, globs, quotes, variables, builtins) still
+// goes through /bin/sh -c.
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "graph.h"
+
+extern char** environ;
+
+static const char* shellBuiltins[] = {
+    ".", ":", "alias", "cd", "command", "eval", "exec", "exit", "export",
+    "getopts", "hash", "local", "read", "readonly", "return", "set", "shift",
+    "source", "times", "trap", "type", "ulimit", "umask", "unalias", "unset", "wait",
+    NULL
+};
+
+int needsShell(const char* command) {
+    // Characters that mean something to the shell, anywhere in the line
+    if (strpbrk(command, "|&;<>()$`\\\"'*?[]#~!{}\n") != NULL) {
+        return 1;
+    }
+
+    const char* word = command + strspn(command, " \t");
+    size_t length = strcspn(word, " \t");
+    if (length == 0) {
+        return 1;  // Let the shell deal with blank lines
+    }
+    if (memchr(word, '=', length) != NULL) {
+        return 1;  // Leading VAR=value assignment
+    }
+    for (int i = 0; shellBuiltins[i] != NULL; i++) {
+        if (strlen(shellBuiltins[i]) == length && strncmp(word, shellBuiltins[i], length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static pid_t spawnDirect(const char* command) {
+    // Split a copy of the line into words, argv points into the copy
+    char* words = strdup(command);
+    int argc = 0, capacity = 8;
+    char** argv = (char**)malloc(capacity * sizeof(char*));
+    if (!words || !argv) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+
+    for (char* word = strtok(words, " \t"); word != NULL; word = strtok(NULL, " \t")) {
+        if (argc + 1 == capacity) {
+            capacity *= 2;
+            argv = (char**)realloc(argv, capacity * sizeof(char*));
+            if (!argv) {
+                fprintf(stderr, "Failed to allocate memory for the graph.\n");
+                exitWithError();
+            }
+        }
+        argv[argc++] = word;
+    }
+    argv[argc] = NULL;
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (error != 0) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(error));
+        pid = -1;
+    }
+    free(argv);
+    free(words);
+    return pid;
+}
+
+static pid_t spawnShell(const char* command) {
+    char* argv[] = { "sh", "-c", (char*)command, NULL };
+
+    pid_t pid;
+    int error = posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, environ);
+    if (error != 0) {
+        fprintf(stderr, "/bin/sh: %s\n", strerror(error));
+        pid = -1;
+    }
+    return pid;
+}
+
+pid_t spawnCommand(const char* command) {
+    fflush(stdout);  // Don't let the child inherit buffered output
+    return needsShell(command) ? spawnShell(command) : spawnDirect(command);
+}
+
+// Exit status of the command, -1 if it was killed or could not be waited for
+int waitForCommand(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void executeShellCommand(const char* target, const char* command) {
+    printf("%s\n", command);
+    int64_t start = traceNow();
+    pid_t pid = spawnCommand(command);
+    int status = pid < 0 ? -1 : waitForCommand(pid);
+    traceSpan(command, "recipe", target, start, 0, status);
+
+    // Check the return value.
+    if (status != 0) {
+        fprintf(stderr, "Command failed to execute\n");
+        exitWithError();
+    }
+    return;
+}
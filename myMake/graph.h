@@ -2,54 +2,202 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/types.h>
 
 
+// Traversal states kept in GraphNode.state
+#define NODE_UNVISITED 0
+#define NODE_VISITING 1
+#define NODE_DONE 2
+
+// Status recorded for trace spans that are not recipe lines
+#define TRACE_NO_STATUS (-1000)
+
 typedef struct GraphNode {
     char* name;
-    struct GraphNode* firstChild;
-    struct GraphNode* right;
-    struct GraphNode* parent;
     struct CommandNode* commands;
-    int isPointerNode;
-    struct GraphNode* originalNode;
-    int printed;
+    int numPrereqs;      // Prerequisites added while parsing, a target that has some can't be declared again
+    int state;           // NODE_UNVISITED, NODE_VISITING or NODE_DONE during a build
+
+    int fileExists;      // 1 if the file exists, 0 if not
+    time_t mtime;        // Modification time, valid when fileExists is 1
+
+    // Bookkeeping for the parallel (-j) scheduler
+    int scheduled;       // Reached from the goal
+    int pendingPrereqs;  // Prerequisites that are not built yet
 
-    struct stat fileInfo;  // New field to store file information
-    int fileExists;        // New field to indicate if file exists (1 for exists, 0 for not exists)
+    int outOfDate;       // Set by checkSubtree (-n and -q)
+
+    uint64_t signature;  // Recipe and prerequisite content hash for this build (-H and --cache)
+
+    int patternRule;     // Pattern rule node plus one that supplied the recipe, 0 if none
 } GraphNode;
 
+// The dependency graph. Nodes live in one array and are referred to by
+// their index. Edges are appended to a plain edge list while parsing and
+// finalizeGraph turns them into compressed adjacency arrays: the
+// prerequisites of node i are prereqs[prereqStart[i] .. prereqStart[i + 1]),
+// in makefile order, and dependents/dependentStart hold the reverse edges,
+// in node order. A graph loaded from the graph cache is finalized already
+// and has no edge list until it changes (see detachGraph).
+typedef struct Graph {
+    GraphNode* nodes;
+    int numNodes;
+    int nodeCapacity;
+
+    int* slots;          // Name index, open addressing over node ids, -1 when empty
+    int slotCapacity;
+
+    int* edgeFrom;       // Edge list: edgeFrom[e] depends on edgeTo[e]
+    int* edgeTo;
+    int numEdges;
+    int edgeCapacity;
+
+    int* prereqStart;    // Compressed adjacency, numNodes + 1 entries
+    int* prereqs;
+    int* dependentStart;
+    int* dependents;
+
+    int* patterns;       // Pattern rule nodes ('%' in the target), in makefile order
+    int numPatterns;
+    int patternCapacity;
+
+    int mapped;          // slots, the adjacency arrays and patterns are in the read-only graph cache mapping
+} Graph;
+
+// A piece of a recipe line that uses automatic variables
+typedef struct CommandPart {
+    const char* text;    // Literal text, NULL for a variable
+    int length;
+    char variable;       // '@', '<' or '^', 0 for literal text
+} CommandPart;
+
 typedef struct CommandNode {
     char* command;
     struct CommandNode* next;
+    CommandPart* parts;  // The line split at $@, $< and $^, NULL if it has none
+    int numParts;
 } CommandNode;
 
+typedef struct HashEntry {
+    const char* key;
+    unsigned long hash;
+    void* value;
+} HashEntry;
+
+typedef struct HashMap {
+    HashEntry* entries;
+    size_t capacity;
+    size_t count;
+} HashMap;
+
+typedef struct Arena {
+    struct ArenaBlock* head;
+    size_t allocations;    // Number of arenaAlloc calls
+    size_t usedBytes;      // Bytes handed out
+    size_t reservedBytes;  // Bytes currently held in blocks
+    size_t peakBytes;      // Highest reservedBytes seen
+} Arena;
+
 extern char clean[];
-extern GraphNode* tree;
+extern Graph* tree;
+extern Arena graphArena;   // Owns every CommandNode and copied name
+extern long statLookups;
+extern long statCalls;
+extern int useSignatures;
+extern int useArtifactCache;
+extern long artifactHits;
+extern long artifactMisses;
+extern long depfilesRead;
+extern long depfileEdges;
+extern long patternTargets;
 
 //int isUpToDate = 1;
 
 // Function prototypes
 void remove_spaces(char* s);
-void addChild(GraphNode* parent, char* childName, GraphNode* graph);
+void initGraph(Graph* graph);
+int lookupNode(Graph* graph, const char* nodeName);
+int findOrCreateNode(Graph* graph, char* nodeName);
+void addEdge(Graph* graph, int target, int prereq);
+int defineTarget(Graph* graph, const char* targetName);
+void addDependency(Graph* graph, int target, const char* dependencyName, size_t length);
+void finalizeGraph(Graph* graph);
+void detachGraph(Graph* graph);
+int reportCycles(Graph* graph, const char* goalName);
 void addCommand(GraphNode* node, char* command);
-char* readInputFromFile(char* filename, GraphNode** graph, int TargetExists);
-GraphNode* findOrCreateNode(GraphNode** graph, char* nodeName);
-GraphNode* searchNode(GraphNode* current, char* nodeName, GraphNode* callingParent);
-void printSubtreehelper(GraphNode* current, GraphNode* callingParent, GraphNode* rootNode, int startPrinting);
-void printCommands(GraphNode* node);
-void printSubtree(GraphNode* rootNode);
+char* readInputFromFile(char* filename, Graph* graph, int TargetExists);
+void releaseMakefile();
+int buildOrder(Graph* graph, int goal, int* order);
+void printCommands(Graph* graph, int current);
+void printSubtree(Graph* graph, int rootNode);
+int checkSubtree(Graph* graph, int goal, int printRecipes);
 int characterExists(char* str, char c);
-GraphNode* findParentNode(GraphNode* current);
-GraphNode* findLeftSibling(GraphNode* node);
-void disconnectAndAddToNewParent(GraphNode* mainNode, GraphNode* node, GraphNode* newParent);
-void freeGraph(GraphNode* node);
-void executeShellCommand(const char* command);
-int hasNewerChild(GraphNode* targetNode);
+void freeGraph(Graph* graph);
+void executeShellCommand(const char* target, const char* command);
+int hasNewerChild(Graph* graph, int target);
+int needsRebuild(Graph* graph, int target);
+void markBuilt(GraphNode* node);
 void initializeGraphNode(GraphNode* node);
 void exitWithError();
+int needsShell(const char* command);
+pid_t spawnCommand(const char* command);
+int waitForCommand(pid_t pid);
+void buildParallel(Graph* graph, int goal, int maxJobs);
+
+void* arenaAlloc(Arena* arena, size_t size);
+char* arenaStrdup(Arena* arena, const char* s);
+void arenaRelease(Arena* arena);
+
+unsigned long hashString(const char* s);
+unsigned long hashName(const char* s, size_t length);
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed);
+void hashMapInit(HashMap* map, size_t capacity);
+void* hashMapGet(HashMap* map, const char* key);
+void hashMapPut(HashMap* map, const char* key, void* value);
+void hashMapFree(HashMap* map);
+
+int cachedStat(const char* path, struct stat* info);
+void invalidateStat(const char* path);
+void freeStatCache();
+
+void openSignatureDatabase(const char* makefile, int readOnly);
+void closeSignatureDatabase();
+uint64_t fileSignature(const char* path);
+uint64_t computeSignature(Graph* graph, int target);
+int signatureChanged(Graph* graph, int target);
+void recordSignature(GraphNode* node);
+
+void writeGraphCache(const char* makefile, Graph* graph, const char* firstTarget);
+int loadGraphCache(const char* makefile, Graph* graph, char** firstTarget);
+void closeGraphCache();
+
+void splitCommand(CommandNode* command);
+const char* expandCommand(Graph* graph, int target, CommandNode* command);
+int instantiatePatterns(Graph* graph, const char* goalName);
+void freePatterns();
+
+int loadDepfiles(Graph* graph);
+int isDepfile(const char* path);
+void freeDepfiles();
+
+void openArtifactCache(const char* directory, long long maxBytes);
+int restoreArtifact(Graph* graph, int target);
+void storeArtifact(GraphNode* node);
+void closeArtifactCache();
+
+void runServer(Graph* graph, const char* makefile, int defaultGoal, int jobs, char* argv[]);
+int runClient(const char* makefile, const char* target, int build);
+
+void startTrace(const char* path);
+int64_t traceNow();
+void traceSpan(const char* name, const char* category, const char* target,
+               int64_t startNs, int lane, int status);
+void writeTrace();
 
 #endif // GRAPH_H
@@ -2,213 +2,373 @@
 #include "graph.h"
 
 
-GraphNode* searchNode(GraphNode* current, char* nodeName, GraphNode* callingParent) {
-    if (!current) {
-        return NULL;  // Base case
-    }
+void initGraph(Graph* graph) {
+    memset(graph, 0, sizeof(Graph));
+}
 
-    // Check the current node, but skip if it's a pointer node
-    if (strcmp(current->name, nodeName) == 0 && !current->isPointerNode) {
-        return current;  // Node found
+static void growNameIndex(Graph* graph) {
+    int capacity = graph->slotCapacity ? graph->slotCapacity * 2 : 1024;
+    int* slots = (int*)malloc(capacity * sizeof(int));
+    if (!slots) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
     }
+    memset(slots, -1, capacity * sizeof(int));
 
-    // Check for child, go to child if exists and not backtracking to calling parent
-    if (current->firstChild && current != callingParent) {
-        return searchNode(current->firstChild, nodeName, current);
+    // Reinsert every node, names are unique so no comparisons are needed
+    for (int id = 0; id < graph->numNodes; id++) {
+        size_t i = hashString(graph->nodes[id].name) & (capacity - 1);
+        while (slots[i] != -1) {
+            i = (i + 1) & (capacity - 1);
+        }
+        slots[i] = id;
     }
+    free(graph->slots);
+    graph->slots = slots;
+    graph->slotCapacity = capacity;
+}
 
-    // If no child, check for right sibling
-    if (!current->firstChild && current->right) {
-        return searchNode(current->right, nodeName, callingParent);
+// Returns the slot where the name of the given length is, or where it
+// would be inserted. nodeName need not end in a NUL.
+static size_t findSlot(Graph* graph, const char* nodeName, size_t length) {
+    size_t i = hashName(nodeName, length) & (graph->slotCapacity - 1);
+    while (graph->slots[i] != -1) {
+        const char* name = graph->nodes[graph->slots[i]].name;
+        if (strncmp(name, nodeName, length) == 0 && name[length] == '\0') {
+            break;
+        }
+        i = (i + 1) & (graph->slotCapacity - 1);  // Linear probing
     }
+    return i;
+}
 
-    // If no child and no right sibling, go to parent
-    if (!current->firstChild && !current->right) {
-        return searchNode(current->parent, nodeName, current->parent);
+int lookupNode(Graph* graph, const char* nodeName) {
+    if (graph->slotCapacity == 0) {
+        return -1;
     }
+    return graph->slots[findSlot(graph, nodeName, strlen(nodeName))];
+}
 
-    // Special case: if current node is the calling parent and has a right sibling
-    if (current == callingParent && current->right) {
-        return searchNode(current->right, nodeName, current);
+// Looks the name up and appends a node for it if there is none. A new
+// node keeps nodeName itself, or an arena copy of it if copyName is set;
+// only a copied name may be length bytes of a longer string.
+static int addNode(Graph* graph, const char* nodeName, size_t length, int copyName) {
+    if (graph->mapped) {
+        detachGraph(graph);
     }
-
-    // Special case: if current node is the calling parent and has no right sibling
-    if (current == callingParent && !current->right) {
-        return searchNode(current->parent, nodeName, current->parent);
+    if ((graph->numNodes + 1) * 10 > graph->slotCapacity * 7) {
+        growNameIndex(graph);
     }
-
-    return NULL;
-}
-
-GraphNode* findParentNode(GraphNode* current) {
-    if (!current) {
-        return NULL;  // Base case for null input
+    size_t slot = findSlot(graph, nodeName, length);
+    if (graph->slots[slot] != -1) {
+        return graph->slots[slot];
     }
 
-    if (current->parent != NULL) {
-        return current->parent;  // Return the parent if it exists
+    // Node not found, append a new one
+    if (graph->numNodes == graph->nodeCapacity) {
+        graph->nodeCapacity = graph->nodeCapacity ? graph->nodeCapacity * 2 : 1024;
+        graph->nodes = (GraphNode*)realloc(graph->nodes, graph->nodeCapacity * sizeof(GraphNode));
+        if (!graph->nodes) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+    }
+    int id = graph->numNodes++;
+    GraphNode* node = &graph->nodes[id];
+    memset(node, 0, sizeof(GraphNode));
+    if (copyName) {
+        node->name = (char*)arenaAlloc(&graphArena, length + 1);
+        memcpy(node->name, nodeName, length);
+        node->name[length] = '\0';
     }
     else {
-        // If the current node has no parent, move right until a node with a parent is found
-        return findParentNode(current->right);
+        node->name = (char*)nodeName;
     }
+    graph->slots[slot] = id;
+    return id;
 }
 
-GraphNode* findLeftSibling(GraphNode* node) {
-    if (node == NULL || findParentNode(node) == NULL) {
-        return NULL;  // No left sibling if node is NULL or if node has no parent
-    }
+int findOrCreateNode(Graph* graph, char* nodeName) {
+    return addNode(graph, nodeName, strlen(nodeName), 0);  // Callers pass names that live as long as the graph
+}
 
-    // Find the parent of the node
-    GraphNode* parent = findParentNode(node);
+void addEdge(Graph* graph, int target, int prereq) {
+    if (graph->mapped) {
+        detachGraph(graph);
+    }
+    if (graph->numEdges == graph->edgeCapacity) {
+        graph->edgeCapacity = graph->edgeCapacity ? graph->edgeCapacity * 2 : 1024;
+        graph->edgeFrom = (int*)realloc(graph->edgeFrom, graph->edgeCapacity * sizeof(int));
+        graph->edgeTo = (int*)realloc(graph->edgeTo, graph->edgeCapacity * sizeof(int));
+        if (!graph->edgeFrom || !graph->edgeTo) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+    }
+    graph->edgeFrom[graph->numEdges] = target;
+    graph->edgeTo[graph->numEdges] = prereq;
+    graph->numEdges++;
+    graph->nodes[target].numPrereqs++;
+}
 
-    // Traverse the children of the parent to find the left sibling of 'node'
-    GraphNode* currentNode = parent->firstChild;
-    while (currentNode != NULL && currentNode->right != node) {
-        currentNode = currentNode->right;
+int defineTarget(Graph* graph, const char* targetName) {
+    int existingTarget = lookupNode(graph, targetName);
+    if (existingTarget != -1 && graph->nodes[existingTarget].numPrereqs > 0) {
+        printf("Target, %s, declared more than once\nIllegal File Format\n", targetName);
+        exitWithError();
+    }
+    int id = addNode(graph, targetName, strlen(targetName), 1);  // Detaches a mapped graph
+    if (strchr(targetName, '%')) {
+        // Pattern rules are only matched against targets once the goal is known
+        if (graph->numPatterns == graph->patternCapacity) {
+            graph->patternCapacity = graph->patternCapacity ? graph->patternCapacity * 2 : 16;
+            graph->patterns = (int*)realloc(graph->patterns, graph->patternCapacity * sizeof(int));
+            if (!graph->patterns) {
+                fprintf(stderr, "Failed to allocate memory for the graph.\n");
+                exitWithError();
+            }
+        }
+        graph->patterns[graph->numPatterns++] = id;
     }
+    return id;
+}
 
-    return currentNode;  // currentNode is the left sibling of 'node', NULL if 'node' is the first child
+// dependencyName is the first length bytes of a line of the makefile
+void addDependency(Graph* graph, int target, const char* dependencyName, size_t length) {
+    addEdge(graph, target, addNode(graph, dependencyName, length, 1));
 }
 
-void addChild(GraphNode* parent, char* childName, GraphNode* graph) {
-    // Search for an existing node with the same name
-    GraphNode* existingNode = searchNode(graph, childName, NULL);
-
-    GraphNode* newChild;
-    newChild = (GraphNode*)malloc(sizeof(GraphNode));
-    newChild->name = strdup(childName);  // Duplicate the name for the pointer node
-    newChild->firstChild = NULL;
-    newChild->right = NULL;
-    newChild->parent = parent;
-    newChild->commands = NULL;  // Assuming pointer nodes don't have their own commands
-    //initializeGraphNode(newChild);
-    GraphNode* findParentNode(GraphNode * current);
-    GraphNode* findLeftSibling(GraphNode * node);
-
-    if (existingNode) {
-        // If an existing node is found, create a pointer node
-        newChild->isPointerNode = 1;  // Mark this as a pointer node
-        newChild->originalNode = existingNode;  // Point to the existing node
+// Counting sort of the edge list by one endpoint. Edges keep their relative
+// order, so prerequisites come out in the order the makefile listed them.
+static void buildAdjacency(Graph* graph, int* keys, int* values, int** startOut, int** listOut) {
+    int* start = (int*)calloc(graph->numNodes + 1, sizeof(int));
+    int* list = (int*)malloc((graph->numEdges ? graph->numEdges : 1) * sizeof(int));
+    if (!start || !list) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
     }
-    else {
-        // If no existing node is found, create a regular node
-        newChild->isPointerNode = 0;
-        newChild->originalNode = NULL;
+    for (int e = 0; e < graph->numEdges; e++) {
+        start[keys[e] + 1]++;
     }
-
-    // Add the new child to the parent node
-    if (parent->firstChild == NULL) {
-        parent->firstChild = newChild;
+    for (int id = 0; id < graph->numNodes; id++) {
+        start[id + 1] += start[id];
     }
-    else {
-        GraphNode* rightmostChild = parent->firstChild;
-        while (rightmostChild->right != NULL) {
-            rightmostChild = rightmostChild->right;
-        }
-        rightmostChild->right = newChild;
-        rightmostChild->parent = NULL;
+    int* next = (int*)malloc((graph->numNodes + 1) * sizeof(int));
+    if (!next) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    memcpy(next, start, (graph->numNodes + 1) * sizeof(int));
+    for (int e = 0; e < graph->numEdges; e++) {
+        list[next[keys[e]]++] = values[e];
     }
+    free(next);
+
+    free(*startOut);
+    free(*listOut);
+    *startOut = start;
+    *listOut = list;
 }
 
-void disconnectAndAddToNewParent(GraphNode* mainNode, GraphNode* node, GraphNode* newParent) {
-    if (node == NULL || newParent == NULL) {
-        return;  // Do nothing if either node is NULL
+void finalizeGraph(Graph* graph) {
+    if (graph->mapped) {
+        return;  // Loaded finalized from the graph cache and unchanged since
     }
+    buildAdjacency(graph, graph->edgeFrom, graph->edgeTo, &graph->prereqStart, &graph->prereqs);
 
-    // Find the left sibling of the node to be disconnected
-    GraphNode* leftSibling = findLeftSibling(node);
-
-    // Disconnect the node from its current position
-    if (leftSibling != NULL && node->right) {
-        leftSibling->right = node->right;  // Bypass the node being moved
+    // Dependents are sorted out of the prerequisite lists rather than the
+    // edge list, so they come in node order whatever order the edges were
+    // added in, and a graph detached from the cache gets the same ones
+    int* owner = (int*)malloc((graph->numEdges ? graph->numEdges : 1) * sizeof(int));
+    if (!owner) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
     }
-    else if (leftSibling != NULL && !node->right) {
-        leftSibling->right = node->parent;  // Bypass the node being moved
+    for (int id = 0; id < graph->numNodes; id++) {
+        for (int e = graph->prereqStart[id]; e < graph->prereqStart[id + 1]; e++) {
+            owner[e] = id;
+        }
     }
-    else if (mainNode->firstChild == node) {
-        mainNode->firstChild = node->right;  // If node is the first child of mainNode
+    buildAdjacency(graph, graph->prereqs, owner, &graph->dependentStart, &graph->dependents);
+    free(owner);
+}
+
+static int* copyInts(const int* array, int count) {
+    int* copy = (int*)malloc((count ? count : 1) * sizeof(int));
+    if (!copy) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
     }
+    memcpy(copy, array, count * sizeof(int));
+    return copy;
+}
 
-    // Add the node as the rightmost child of the new parent
-    if (newParent->firstChild == NULL) {
-        newParent->firstChild = node;  // If newParent has no children
+// A graph loaded from the graph cache uses the mapping's arrays, which are
+// read-only. Before the first change, copy them to the heap and rebuild
+// the edge list from the prerequisite lists; finalizeGraph then gives the
+// same adjacency back. Names and recipe lines stay in the mapping.
+void detachGraph(Graph* graph) {
+    int rows = graph->numNodes + 1;
+    graph->slots = copyInts(graph->slots, graph->slotCapacity);
+    graph->prereqStart = copyInts(graph->prereqStart, rows);
+    graph->prereqs = copyInts(graph->prereqs, graph->numEdges);
+    graph->dependentStart = copyInts(graph->dependentStart, rows);
+    graph->dependents = copyInts(graph->dependents, graph->numEdges);
+    graph->patterns = copyInts(graph->patterns, graph->numPatterns);
+    graph->mapped = 0;
+
+    graph->edgeCapacity = graph->numEdges ? graph->numEdges : 1;
+    graph->edgeFrom = (int*)malloc(graph->edgeCapacity * sizeof(int));
+    graph->edgeTo = copyInts(graph->prereqs, graph->numEdges);
+    if (!graph->edgeFrom) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
     }
-    else {
-        GraphNode* rightmostChild = newParent->firstChild;
-        while (rightmostChild->right != NULL) {
-            rightmostChild = rightmostChild->right;
+    for (int id = 0; id < graph->numNodes; id++) {
+        for (int e = graph->prereqStart[id]; e < graph->prereqStart[id + 1]; e++) {
+            graph->edgeFrom[e] = id;
         }
-        rightmostChild->right = node;  // Add node to the right of the rightmost child
-        rightmostChild->parent = NULL;
     }
-    node->parent = newParent;
-    node->right = NULL;  // The moved node now has no right sibling
 }
 
-GraphNode* findOrCreateNode(GraphNode** graph, char* nodeName) {
-    GraphNode* found = searchNode(*graph, nodeName, NULL);
+// Post-order of everything the goal depends on: each node comes after all
+// of its prerequisites, which are visited in makefile order. The walk keeps
+// its own stack of (node, next edge) pairs on the heap, so chain depth is
+// limited by memory rather than by the native stack. Returns the number of
+// ids written to order, which must have room for numNodes ids.
+int buildOrder(Graph* graph, int goal, int* order) {
+    int* stackNode = (int*)malloc(graph->numNodes * sizeof(int));
+    int* stackEdge = (int*)malloc(graph->numNodes * sizeof(int));
+    if (!stackNode || !stackEdge) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    int depth = 0, count = 0;
+
+    if (graph->nodes[goal].state != NODE_DONE) {
+        graph->nodes[goal].state = NODE_VISITING;
+        stackNode[depth] = goal;
+        stackEdge[depth++] = graph->prereqStart[goal];
+    }
+    while (depth > 0) {
+        int current = stackNode[depth - 1];
+        if (stackEdge[depth - 1] == graph->prereqStart[current + 1]) {
+            // Every prerequisite is placed, the node itself can follow
+            graph->nodes[current].state = NODE_DONE;
+            order[count++] = current;
+            depth--;
+            continue;
+        }
 
-    if (found) {
-        return found;
+        int prereq = graph->prereqs[stackEdge[depth - 1]++];
+        GraphNode* node = &graph->nodes[prereq];
+        if (node->state == NODE_DONE) {
+            continue;  // Already placed through another dependent
+        }
+        if (node->state == NODE_VISITING) {
+            fprintf(stderr, "Circular dependency detected at %s\n", node->name);
+            free(stackNode);
+            free(stackEdge);
+            exitWithError();
+        }
+        node->state = NODE_VISITING;
+        stackNode[depth] = prereq;
+        stackEdge[depth++] = graph->prereqStart[prereq];
     }
 
-    // Node not found, create a new node and add it as a child to the graph root node
-    addChild(*graph, nodeName, *graph); // Add new node to the graph
-    return searchNode(*graph, nodeName, NULL);  // Return the newly added node
+    free(stackNode);
+    free(stackEdge);
+    return count;
 }
 
-void printSubtreehelper(GraphNode* current, GraphNode* callingParent, GraphNode* rootNode, int startPrinting) {
-    if (!current) {
-        return;  // Base case
+void printCommands(Graph* graph, int current) {
+    GraphNode* node = &graph->nodes[current];
+
+    int64_t start = traceNow();
+    initializeGraphNode(node);
+    int rebuild = needsRebuild(graph, current);
+    traceSpan("up-to-date check", "stat", node->name, start, 0, TRACE_NO_STATUS);
+    if (rebuild) {
+        CommandNode* commands = node->commands;
+        if (!commands) {
+            fprintf(stderr, "File not found and not a target: %s\n", node->name);
+            exitWithError();
+        }
+        if (useArtifactCache && restoreArtifact(graph, current)) {
+            markBuilt(node);
+            return;
+        }
+        while (commands) {
+            executeShellCommand(node->name, expandCommand(graph, current, commands));
+            commands = commands->next;
+        }
+        markBuilt(node);
+        if (useArtifactCache) {
+            storeArtifact(node);
+        }
     }
+}
 
-    // Check for child, go to child if exists and not backtracking to calling parent
-    if (current->firstChild && current != callingParent) {
-        return printSubtreehelper(current->firstChild, current, rootNode, startPrinting);
-    }
-    else {
-        startPrinting = 1;  // Start printing from this node onwards
-    }
-    if (startPrinting) {
-        printCommands(current);
-    }
-    // If no child, check for right sibling
-    if (current != rootNode && current->right) {
-        return printSubtreehelper(current->right, callingParent, rootNode, startPrinting);
+void printSubtree(Graph* graph, int rootNode) {
+    int* order = (int*)malloc(graph->numNodes * sizeof(int));
+    if (!order) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
     }
-    else if (current != rootNode && current->parent) {
-        // Go to the parent's right sibling if not at the root node
-        return printSubtreehelper(current->parent, current->parent, rootNode, startPrinting);
+    int count = buildOrder(graph, rootNode, order);
+    for (int i = 0; i < count; i++) {
+        printCommands(graph, order[i]);
     }
+    free(order);
 }
 
-void printCommands(GraphNode* node) {
-    if (!node->isPointerNode && node->printed != 1) {
-        node->printed = 1;
+// Dry run of a build (-n and -q). Walks the build order once, bottom-up,
+// and runs nothing. A target is out of date if needsRebuild says so or if a
+// prerequisite is, since rebuilding that one would make it newer. With
+// printRecipes set, the recipes of out-of-date targets are printed in the
+// order a build would run them; otherwise the walk stops at the first one.
+// Returns the number of out-of-date targets found.
+int checkSubtree(Graph* graph, int goal, int printRecipes) {
+    int* order = (int*)malloc(graph->numNodes * sizeof(int));
+    if (!order) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    int count = buildOrder(graph, goal, order);
+    int outOfDate = 0;
 
+    for (int i = 0; i < count; i++) {
+        GraphNode* node = &graph->nodes[order[i]];
         initializeGraphNode(node);
-        if (node->fileExists == 0 || hasNewerChild(node) == 1) {
-            CommandNode* commands = node->commands;
-            if (!commands) {
-                fprintf(stderr, "File not found and not a target: %s\n", node->name);
-                exitWithError();
-            }
-            while (commands) {
-                executeShellCommand(commands->command);
-                commands = commands->next;
+        node->outOfDate = 0;
+        for (int e = graph->prereqStart[order[i]]; e < graph->prereqStart[order[i] + 1]; e++) {
+            if (graph->nodes[graph->prereqs[e]].outOfDate) {
+                node->outOfDate = 1;
+                break;
             }
-            initializeGraphNode(node);
+        }
+        // Only asked when every prerequisite is current, so they all exist
+        if (!node->outOfDate && needsRebuild(graph, order[i])) {
+            node->outOfDate = 1;
+        }
+        if (!node->outOfDate) {
+            continue;
+        }
+        if (!node->commands) {
+            fprintf(stderr, "File not found and not a target: %s\n", node->name);
+            free(order);
+            exitWithError();
+        }
+        outOfDate++;
+        if (!printRecipes) {
+            break;
+        }
+        for (CommandNode* command = node->commands; command != NULL; command = command->next) {
+            printf("%s\n", expandCommand(graph, order[i], command));
         }
     }
-    else {
-        // For a pointer node, print the subtree of the node it points to
-        printSubtreehelper(node->originalNode, NULL, node->originalNode, 1);
-    }
-}
-
-void printSubtree(GraphNode* rootNode) {
-    printSubtreehelper(rootNode, NULL, rootNode, 0);
+    free(order);
+    return outOfDate;
 }
 
 int characterExists(char* str, char c) {
@@ -220,28 +380,13 @@ int characterExists(char* str, char c) {
     return 0; // Character not found
 }
 
-void executeShellCommand(const char* command) {
-    // Execute the command using system()
-    printf("%s\n", command);
-    int status = system(command);
-
-    // Check the return value.
-    if (status != 0) {
-        fprintf(stderr, "Command failed to execute\n");
-        exitWithError();
-    }
-    return;
-}
-
-int hasNewerChild(GraphNode* targetNode) {
-    if (targetNode->firstChild == NULL) {
-        return 0;
-    }
-    GraphNode* current = targetNode->firstChild;
-    while (current != NULL) {
+int hasNewerChild(Graph* graph, int target) {
+    GraphNode* targetNode = &graph->nodes[target];
+    for (int e = graph->prereqStart[target]; e < graph->prereqStart[target + 1]; e++) {
+        GraphNode* current = &graph->nodes[graph->prereqs[e]];
         initializeGraphNode(current);
         if (current->fileExists) {
-            if (current->fileInfo.st_mtime > targetNode->fileInfo.st_mtime) {
+            if (current->mtime > targetNode->mtime) {
                 return 1; // Found a node with a newer date
             }
         }
@@ -249,9 +394,37 @@ int hasNewerChild(GraphNode* targetNode) {
             fprintf(stderr, "Impossible situation.\n");
             exitWithError();
         }
-        current = current->right; // Move to the next right sibling
     }
 
-    // No sibling node has a newer date
+    // No prerequisite has a newer date
     return 0;
-}
\ No newline at end of file
+}
+
+int needsRebuild(Graph* graph, int target) {
+    GraphNode* node = &graph->nodes[target];
+
+    // Only targets with a recipe get a signature, plain source files never rebuild
+    int changed = (useSignatures && node->commands) ? signatureChanged(graph, target) : -1;
+
+    if (node->fileExists == 0) {
+        return 1;
+    }
+    if (changed >= 0) {
+        return changed;
+    }
+    if (hasNewerChild(graph, target)) {
+        return 1;
+    }
+    if (useSignatures && node->commands) {
+        recordSignature(node);  // First build in -H mode, trust the timestamps this once
+    }
+    return 0;
+}
+
+void markBuilt(GraphNode* node) {
+    invalidateStat(node->name);  // The recipe may have rewritten the file
+    initializeGraphNode(node);
+    if (useSignatures) {
+        recordSignature(node);
+    }
+}
@@ -1,4 +1,7 @@
 // graph_utils.c
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "graph.h"
 
 
@@ -13,9 +16,12 @@ void remove_spaces(char* s) {
 
 void addCommand(GraphNode* node, char* command) {
 
-    CommandNode* newCommand = (CommandNode*)malloc(sizeof(CommandNode));
-    newCommand->command = strdup(command);
+    CommandNode* newCommand = (CommandNode*)arenaAlloc(&graphArena, sizeof(CommandNode));
+    newCommand->command = command;  // Recipe lines live in the arena or the graph cache
     newCommand->next = NULL;  // New command node should point to NULL, as it is at the end
+    newCommand->parts = NULL;
+    newCommand->numParts = 0;
+    splitCommand(newCommand);  // Done once here, so running the line never has to parse it
 
     if (node->commands == NULL) {
         // If there are no commands yet, this is the first command
@@ -31,80 +37,140 @@ void addCommand(GraphNode* node, char* command) {
     }
 }
 
-char* readInputFromFile(char* filename, GraphNode** graph, int TargetExists) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
+// The makefile is mapped read-only and scanned in place; nothing is written
+// to the mapping, so its pages stay shared with the page cache. Only what
+// the graph keeps is copied into the arena: each distinct node name once
+// (defineTarget and addDependency copy the names of new nodes), and each
+// recipe line. Dependencies are looked up by length, the target goes
+// through a scratch copy to have its spaces removed.
+static char* scratch = NULL;
+static size_t scratchCapacity = 0;
+
+// Copies length bytes into the scratch buffer and NUL-terminates them
+static char* scratchCopy(const char* text, size_t length) {
+    if (length + 1 > scratchCapacity) {
+        scratchCapacity = scratchCapacity ? scratchCapacity : 256;
+        while (length + 1 > scratchCapacity) {
+            scratchCapacity *= 2;
+        }
+        free(scratch);
+        scratch = (char*)malloc(scratchCapacity);
+        if (!scratch) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+    }
+    memcpy(scratch, text, length);
+    scratch[length] = '\0';
+    return scratch;
+}
+
+// Frees the scratch buffer, the mapping itself is gone once parsing ends
+void releaseMakefile() {
+    free(scratch);
+    scratch = NULL;
+    scratchCapacity = 0;
+}
+
+static char* mapMakefile(char* filename, size_t* size) {
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Could not open file %s for reading.\n", filename);
+        exitWithError();
+    }
+    *size = info.st_size;
+    char* data = NULL;
+    if (*size > 0) {
+        data = (char*)mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
         fprintf(stderr, "Could not open file %s for reading.\n", filename);
         exitWithError();
     }
+    return data;
+}
 
-    char line[1024];
-    GraphNode* currentParent = NULL;
+char* readInputFromFile(char* filename, Graph* graph, int TargetExists) {
+    size_t size;
+    char* data = mapMakefile(filename, &size);
+    const char* line = data;
+    const char* end = data + size;
+    int currentParent = -1;
     char* firstTarget = NULL;  // For storing the first target name
 
-    while (fgets(line, sizeof(line), file)) {
-        // Remove newline character
-        line[strcspn(line, "\n")] = 0;
+    for (const char* next; line < end; line = next) {
+        // Lines can be any length, each one ends at its newline
+        const char* newline = (const char*)memchr(line, '\n', end - line);
+        const char* lineEnd = newline ? newline : end;
+        int length = (int)(lineEnd - line);
+        next = lineEnd + 1;
 
         // Ignore empty lines
-        if (strlen(line) == 0) continue;
+        if (lineEnd == line) continue;
 
         // If line starts with a tab, it's a command
         if (line[0] == '\t') {
-            if (currentParent == NULL) {
-                printf("command without a target: %s\nIllegal File Format\n", line + 1);
+            if (currentParent == -1) {
+                printf("command without a target: %.*s\nIllegal File Format\n", length - 1, line + 1);
                 exitWithError();
             }
-            addCommand(currentParent, line + 1); // Skip the tab character
+            // Skip the tab character
+            char* command = (char*)arenaAlloc(&graphArena, length);
+            memcpy(command, line + 1, length - 1);
+            command[length - 1] = '\0';
+            addCommand(&graph->nodes[currentParent], command);
             continue;
         }
 
         // Split the line to get parent and child nodes
-        if (!characterExists(line, ':')) {
-            printf("No ':' on definition line: %s\nIllegal File Format\n", line);
+        const char* colon = (const char*)memchr(line, ':', length);
+        if (!colon) {
+            printf("No ':' on definition line: %.*s\nIllegal File Format\n", length, line);
 
             exitWithError();
         }
-        char* token = strtok(line, ":");
+        char* token = scratchCopy(line, colon - line);
         remove_spaces(token);
 
         if (strcmp(token, "clean") == 0 || strcmp(token, "clear") == 0) {
-            fgets(line, sizeof(line), file);
-            line[strcspn(line, "\n")] = 0;
-
-            strcpy(clean, "line + 1");
+            // The clean recipe is the single line that follows
+            if (next < end) {
+                newline = (const char*)memchr(next, '\n', end - next);
+                lineEnd = newline ? newline : end;
+                if (lineEnd > next) {
+                    next++;  // Skip the tab
+                }
+                snprintf(clean, 1024, "%.*s", (int)(lineEnd - next), next);
+                next = lineEnd + 1;
+            }
             continue;
         }
-        if (TargetExists == 0 && firstTarget == NULL) {
-            firstTarget = strdup(token);  // Dynamically allocate memory for the first target
-        }
 
-        char* parentName = token;
-        GraphNode* test = searchNode(*graph, token, NULL);
-        if (searchNode(*graph, token, NULL) && searchNode(*graph, token, NULL)->firstChild) {
-            printf("Target, %s, declared more than once\nIllegal File Format\n", token);
-            exitWithError();
+        currentParent = defineTarget(graph, token);
+        if (TargetExists == 0 && firstTarget == NULL && !strchr(token, '%')) {
+            firstTarget = graph->nodes[currentParent].name;
         }
-        currentParent = findOrCreateNode(graph, parentName);
-
-        token = strtok(NULL, " ");
-        while (token != NULL) {
-            GraphNode* existingNode = searchNode(*graph, token, NULL);  // Search for the node in the graph
 
-            if (existingNode && findParentNode(existingNode) == *graph) {
-                // If the node exists and its parent is the main node, disconnect and add to the right parent
-                disconnectAndAddToNewParent(*graph, existingNode, currentParent);
+        // Dependencies are separated by spaces
+        const char* cursor = colon + 1;
+        while (cursor < lineEnd) {
+            if (*cursor == ' ') {
+                cursor++;
+                continue;
             }
-            else {
-
-                addChild(currentParent, token, *graph);
-            }
-            token = strtok(NULL, " ");
+            const char* space = (const char*)memchr(cursor, ' ', lineEnd - cursor);
+            const char* tokenEnd = space ? space : lineEnd;
+            addDependency(graph, currentParent, cursor, tokenEnd - cursor);
+            cursor = tokenEnd + 1;
         }
 
     }
+    if (data != NULL) {
+        munmap(data, size);
+    }
 
-    fclose(file);
     if (TargetExists == 0) {
         return firstTarget;  // Return the first target name
     }
@@ -113,30 +179,23 @@ char* readInputFromFile(char* filename, GraphNode** graph, int TargetExists) {
     }
 }
 
-void freeCommands(CommandNode* command) {
-    while (command != NULL) {
-        CommandNode* temp = command;
-        command = command->next;
-        free(temp->command);
-        free(temp);
-    }
-}
-
-void freeGraph(GraphNode* node) {
-    if (node == NULL) return;
-
-    freeGraph(node->firstChild);
-    freeGraph(node->right);
-
-    if (node->name != NULL) {
-        free(node->name);
-    }
-
-    if (node->commands != NULL) {
-        freeCommands(node->commands);
+void freeGraph(Graph* graph) {
+    if (graph != NULL) {
+        free(graph->nodes);
+        free(graph->edgeFrom);
+        free(graph->edgeTo);
+        if (!graph->mapped) {  // Otherwise closeGraphCache unmaps them
+            free(graph->slots);
+            free(graph->prereqStart);
+            free(graph->prereqs);
+            free(graph->dependentStart);
+            free(graph->dependents);
+            free(graph->patterns);
+        }
+        initGraph(graph);
     }
-
-    free(node);
+    // Recipe lists and copied names live in the arena, one call frees every one of them
+    arenaRelease(&graphArena);
 }
 
 void initializeGraphNode(GraphNode* node) {
@@ -145,26 +204,14 @@ void initializeGraphNode(GraphNode* node) {
         return;
     }
 
-    GraphNode* targetNode = node;
-
-    // Check if it's a pointer node
-    if (node->isPointerNode && node->originalNode != NULL) {
-        // Initialize the original node
-        initializeGraphNode(node->originalNode);
-
-        // Copy fileInfo and fileExists from originalNode to the pointer node
-        node->fileInfo = node->originalNode->fileInfo;
-        node->fileExists = node->originalNode->fileExists;
+    struct stat fileInfo;
+    if (cachedStat(node->name, &fileInfo) == 0) {
+        // File exists, remember its modification time
+        node->fileExists = 1;
+        node->mtime = fileInfo.st_mtime;
     }
     else {
-        // For non-pointer nodes or pointer nodes with no original node
-        if (stat(node->name, &node->fileInfo) == 0) {
-            // File exists, populate fileInfo and set fileExists to 1
-            node->fileExists = 1;
-        }
-        else {
-            // File does not exist, set fileExists to 0
-            node->fileExists = 0;
-        }
+        // File does not exist, set fileExists to 0
+        node->fileExists = 0;
     }
-}
\ No newline at end of file
+}
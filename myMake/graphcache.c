@@ -0,0 +1,330 @@
+// graphcache.c
+// Compiled form of a parsed makefile, stored as <makefile>.graph. Once the
+// parsed graph is finalized, its arrays are written out as they are: the
+// name index, both CSR adjacencies and the pattern rule list, with node
+// names and recipe lines as offsets into one string pool. The next run maps
+// the file and points the Graph at those arrays, so nothing is parsed,
+// hashed or sorted again. Only the node array is filled in, one pass that
+// turns offsets into pointers, because nodes also carry per-build state.
+// A graph that changes after loading (pattern rules, depfiles) is copied
+// out of the mapping first, see detachGraph.
+//
+// The cache is trusted only if the makefile's size, mtime and content hash
+// all match the ones it was written for, and every id and offset in it is
+// in bounds. Layout:
+//   GraphCacheHeader
+//   CachedNode nodes[numNodes]
+//   int32_t slots[slotCapacity]
+//   int32_t prereqStart[numNodes + 1], prereqs[numEdges]
+//   int32_t dependentStart[numNodes + 1], dependents[numEdges]
+//   int32_t patterns[numPatterns]
+//   uint32_t commands[numCommands]           string offsets, in node order
+//   char strings[stringBytes]                NUL-terminated names and recipe lines
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "graph.h"
+
+#define GRAPH_CACHE_MAGIC "MYMKGRF2"
+
+typedef struct GraphCacheHeader {
+    char magic[8];
+    uint64_t makefileSize;
+    int64_t makefileMtimeNs;
+    uint64_t makefileHash;
+    uint32_t numNodes;
+    uint32_t numEdges;
+    uint32_t slotCapacity;
+    uint32_t numPatterns;
+    uint32_t numCommands;
+    int32_t firstTarget;       // Node id of the default goal, -1 if there is none
+    uint64_t stringBytes;
+} GraphCacheHeader;
+
+typedef struct CachedNode {
+    uint32_t name;             // String offset of the node name
+    uint32_t numCommands;      // Recipe lines, the next ones in commands[]
+} CachedNode;
+
+// Growable array used while writing
+typedef struct Buffer {
+    char* data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+static void* cacheMapping = NULL;
+static size_t cacheMappingSize = 0;
+
+// Returns 0 if the buffer could not grow. The cache is only an
+// optimization, so the caller gives up writing it instead of failing.
+static int appendBuffer(Buffer* buffer, const void* data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        while (buffer->size + size > capacity) {
+            capacity *= 2;
+        }
+        char* grown = (char*)realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+// Appends s to the string pool and sets its offset. Returns 0 on failure.
+static int appendString(Buffer* strings, const char* s, uint32_t* offset) {
+    *offset = (uint32_t)strings->size;
+    return strings->size + strlen(s) + 1 <= UINT32_MAX && appendBuffer(strings, s, strlen(s) + 1);
+}
+
+// Size, mtime and content hash of the makefile. Returns 0 on success.
+static int makefileSignature(const char* makefile, GraphCacheHeader* header) {
+    int fd = open(makefile, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    header->makefileSize = info.st_size;
+    header->makefileMtimeNs = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    header->makefileHash = hashBytes("", 0, 0);
+    if (info.st_size > 0) {
+        void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        header->makefileHash = hashBytes(data, info.st_size, 0);
+        munmap(data, info.st_size);
+    }
+    close(fd);
+    return 0;
+}
+
+// Writes the graph as readInputFromFile built it, after finalizeGraph and
+// before pattern rules or depfiles change it. Failing to write is not an error.
+void writeGraphCache(const char* makefile, Graph* graph, const char* firstTarget) {
+    GraphCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_CACHE_MAGIC, 8);
+    header.numNodes = graph->numNodes;
+    header.numEdges = graph->numEdges;
+    header.slotCapacity = graph->slotCapacity;
+    header.numPatterns = graph->numPatterns;
+    header.firstTarget = firstTarget ? lookupNode(graph, firstTarget) : -1;
+
+    Buffer nodes = { 0 }, commands = { 0 }, strings = { 0 };
+    int ok = graph->numNodes > 0 && makefileSignature(makefile, &header) == 0;
+    for (int id = 0; id < graph->numNodes && ok; id++) {
+        GraphNode* node = &graph->nodes[id];
+        CachedNode cached = { 0, 0 };
+        ok = appendString(&strings, node->name, &cached.name);
+        for (CommandNode* command = node->commands; command != NULL && ok; command = command->next) {
+            uint32_t offset;
+            ok = appendString(&strings, command->command, &offset)
+                && appendBuffer(&commands, &offset, sizeof(offset));
+            cached.numCommands++;
+        }
+        ok = ok && appendBuffer(&nodes, &cached, sizeof(cached));
+    }
+    header.numCommands = (uint32_t)(commands.size / sizeof(uint32_t));
+    header.stringBytes = strings.size;
+
+    char path[4096], tempPath[4096];
+    snprintf(path, sizeof(path), "%s.graph", makefile);
+    snprintf(tempPath, sizeof(tempPath), "%s.graph.tmp", makefile);
+    FILE* file = ok ? fopen(tempPath, "wb") : NULL;
+    if (file != NULL) {
+        // Write to a temporary name and rename, so a reader never sees half a cache
+        size_t rows = graph->numNodes + 1;
+        ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(nodes.data, 1, nodes.size, file) == nodes.size
+            && fwrite(graph->slots, sizeof(int), graph->slotCapacity, file) == (size_t)graph->slotCapacity
+            && fwrite(graph->prereqStart, sizeof(int), rows, file) == rows
+            && fwrite(graph->prereqs, sizeof(int), graph->numEdges, file) == (size_t)graph->numEdges
+            && fwrite(graph->dependentStart, sizeof(int), rows, file) == rows
+            && fwrite(graph->dependents, sizeof(int), graph->numEdges, file) == (size_t)graph->numEdges
+            && fwrite(graph->patterns, sizeof(int), graph->numPatterns, file) == (size_t)graph->numPatterns
+            && fwrite(commands.data, 1, commands.size, file) == commands.size
+            && fwrite(strings.data, 1, strings.size, file) == strings.size;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tempPath, path) != 0) {
+            remove(tempPath);  // The cache is only an optimization, carry on without it
+        }
+    }
+    free(nodes.data);
+    free(commands.data);
+    free(strings.data);
+}
+
+// Returns 1 if every id, CSR offset and string offset in the arrays stays
+// inside its array, so a damaged file can't send the loader out of bounds.
+// The string pool must end in a NUL, so every name ends inside it.
+static int arraysInBounds(const GraphCacheHeader* header, const CachedNode* nodes, const int* slots,
+    const int* prereqStart, const int* prereqs, const int* dependentStart, const int* dependents,
+    const int* patterns, const uint32_t* commands, const char* strings) {
+    int numNodes = (int)header->numNodes, numEdges = (int)header->numEdges;
+    if (header->stringBytes == 0 || strings[header->stringBytes - 1] != '\0') {
+        return 0;
+    }
+    uint64_t numCommands = 0;
+    for (int id = 0; id < numNodes; id++) {
+        if (nodes[id].name >= header->stringBytes) {
+            return 0;
+        }
+        numCommands += nodes[id].numCommands;
+    }
+    if (numCommands != header->numCommands) {
+        return 0;
+    }
+    for (uint32_t c = 0; c < header->numCommands; c++) {
+        if (commands[c] >= header->stringBytes) {
+            return 0;
+        }
+    }
+    uint32_t emptySlots = 0;
+    for (uint32_t i = 0; i < header->slotCapacity; i++) {
+        if (slots[i] < -1 || slots[i] >= numNodes) {
+            return 0;
+        }
+        emptySlots += slots[i] == -1;
+    }
+    if (emptySlots == 0) {
+        return 0;  // A lookup of a missing name would probe forever
+    }
+    const int* starts[2] = { prereqStart, dependentStart };
+    const int* lists[2] = { prereqs, dependents };
+    for (int csr = 0; csr < 2; csr++) {
+        if (starts[csr][0] != 0 || starts[csr][numNodes] != numEdges) {
+            return 0;
+        }
+        for (int id = 0; id < numNodes; id++) {
+            if (starts[csr][id + 1] < starts[csr][id]) {
+                return 0;
+            }
+        }
+        for (int e = 0; e < numEdges; e++) {
+            if (lists[csr][e] < 0 || lists[csr][e] >= numNodes) {
+                return 0;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < header->numPatterns; i++) {
+        if (patterns[i] < 0 || patterns[i] >= numNodes) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Points the graph at <makefile>.graph if it is still valid. Returns 1 and
+// sets firstTarget on success, 0 if the makefile has to be parsed. The
+// graph comes back finalized, with graph->mapped set.
+int loadGraphCache(const char* makefile, Graph* graph, char** firstTarget) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.graph", makefile);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    if ((size_t)info.st_size < sizeof(GraphCacheHeader)) {
+        close(fd);
+        return 0;
+    }
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+
+    GraphCacheHeader* header = (GraphCacheHeader*)data;
+    GraphCacheHeader current;
+    uint64_t numNodes = header->numNodes, numEdges = header->numEdges;
+    uint64_t expectedSize = sizeof(GraphCacheHeader) + numNodes * sizeof(CachedNode)
+        + ((uint64_t)header->slotCapacity + 2 * (numNodes + 1) + 2 * numEdges + header->numPatterns) * sizeof(int32_t)
+        + (uint64_t)header->numCommands * sizeof(uint32_t) + header->stringBytes;
+    if (memcmp(header->magic, GRAPH_CACHE_MAGIC, 8) != 0 || expectedSize != (uint64_t)info.st_size
+        || numNodes == 0 || numNodes > INT32_MAX || numEdges > INT32_MAX
+        || header->slotCapacity <= numNodes || (header->slotCapacity & (header->slotCapacity - 1)) != 0
+        || header->firstTarget < -1 || header->firstTarget >= (int64_t)numNodes
+        || makefileSignature(makefile, &current) != 0
+        || current.makefileSize != header->makefileSize || current.makefileMtimeNs != header->makefileMtimeNs
+        || current.makefileHash != header->makefileHash) {
+        munmap(data, info.st_size);
+        return 0;
+    }
+
+    CachedNode* cachedNodes = (CachedNode*)(header + 1);
+    int* slots = (int*)(cachedNodes + numNodes);
+    int* prereqStart = slots + header->slotCapacity;
+    int* prereqs = prereqStart + numNodes + 1;
+    int* dependentStart = prereqs + numEdges;
+    int* dependents = dependentStart + numNodes + 1;
+    int* patterns = dependents + numEdges;
+    uint32_t* cachedCommands = (uint32_t*)(patterns + header->numPatterns);
+    char* cachedStrings = (char*)(cachedCommands + header->numCommands);
+    if (!arraysInBounds(header, cachedNodes, slots, prereqStart, prereqs, dependentStart, dependents,
+            patterns, cachedCommands, cachedStrings)) {
+        munmap(data, info.st_size);
+        return 0;  // Damaged, parse the makefile instead
+    }
+
+    graph->nodes = (GraphNode*)calloc(numNodes, sizeof(GraphNode));
+    if (!graph->nodes) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        munmap(data, info.st_size);
+        exitWithError();
+    }
+    graph->numNodes = graph->nodeCapacity = (int)numNodes;
+    graph->slots = slots;
+    graph->slotCapacity = header->slotCapacity;
+    graph->numEdges = (int)numEdges;
+    graph->prereqStart = prereqStart;
+    graph->prereqs = prereqs;
+    graph->dependentStart = dependentStart;
+    graph->dependents = dependents;
+    graph->patterns = patterns;
+    graph->numPatterns = graph->patternCapacity = header->numPatterns;
+    graph->mapped = 1;
+
+    // Names and recipe lines point into the mapping, keep it until closeGraphCache
+    cacheMapping = data;
+    cacheMappingSize = info.st_size;
+
+    CommandNode* commands = header->numCommands
+        ? (CommandNode*)arenaAlloc(&graphArena, header->numCommands * sizeof(CommandNode)) : NULL;
+    uint32_t nextCommand = 0;
+    for (uint32_t id = 0; id < numNodes; id++) {
+        GraphNode* node = &graph->nodes[id];
+        node->name = cachedStrings + cachedNodes[id].name;
+        node->numPrereqs = prereqStart[id + 1] - prereqStart[id];
+        CommandNode** tail = &node->commands;
+        for (uint32_t c = 0; c < cachedNodes[id].numCommands; c++) {
+            CommandNode* command = &commands[nextCommand];
+            command->command = cachedStrings + cachedCommands[nextCommand++];
+            command->next = NULL;
+            command->parts = NULL;
+            command->numParts = 0;
+            splitCommand(command);
+            *tail = command;
+            tail = &command->next;
+        }
+    }
+    *firstTarget = header->firstTarget >= 0 ? graph->nodes[header->firstTarget].name : NULL;
+    return 1;
+}
+
+void closeGraphCache() {
+    if (cacheMapping != NULL) {
+        munmap(cacheMapping, cacheMappingSize);
+        cacheMapping = NULL;
+    }
+}
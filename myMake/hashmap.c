@@ -0,0 +1,119 @@
+// hashmap.c
+#include "graph.h"
+
+
+unsigned long hashString(const char* s) {
+    // FNV-1a, good enough for file names and cheap to compute
+    unsigned long hash = 14695981039346656037UL;
+    while (*s) {
+        hash ^= (unsigned char)*s++;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+// hashString of the first length bytes of s, which need not end in a NUL
+unsigned long hashName(const char* s, size_t length) {
+    unsigned long hash = 14695981039346656037UL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed) {
+    // Word-at-a-time multiply/xorshift hash, used for file contents where
+    // FNV's byte loop would be the bottleneck
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = seed ^ (length * 0x9E3779B97F4A7C15ULL);
+    uint64_t word;
+
+    while (length >= 8) {
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ (word * 0xBF58476D1CE4E5B9ULL)) * 0x94D049BB133111EBULL;
+        hash ^= hash >> 31;
+        bytes += 8;
+        length -= 8;
+    }
+    word = 0;
+    memcpy(&word, bytes, length);
+    hash = (hash ^ (word * 0xBF58476D1CE4E5B9ULL)) * 0x94D049BB133111EBULL;
+
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    return hash;
+}
+
+void hashMapInit(HashMap* map, size_t capacity) {
+    size_t size = 16;
+    while (size < capacity * 2) {
+        size <<= 1;  // Keep the table a power of two so we can mask instead of mod
+    }
+    map->entries = (HashEntry*)calloc(size, sizeof(HashEntry));
+    if (!map->entries) {
+        fprintf(stderr, "Failed to allocate memory for the hash map.\n");
+        exit(1);
+    }
+    map->capacity = size;
+    map->count = 0;
+}
+
+static HashEntry* findEntry(HashEntry* entries, size_t capacity, const char* key, unsigned long hash) {
+    size_t i = hash & (capacity - 1);
+    while (entries[i].key != NULL) {
+        if (entries[i].hash == hash && strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+        i = (i + 1) & (capacity - 1);  // Linear probing
+    }
+    return &entries[i];  // Empty slot where the key would go
+}
+
+static void growHashMap(HashMap* map) {
+    size_t newCapacity = map->capacity ? map->capacity * 2 : 16;
+    HashEntry* newEntries = (HashEntry*)calloc(newCapacity, sizeof(HashEntry));
+    if (!newEntries) {
+        fprintf(stderr, "Failed to allocate memory for the hash map.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->entries[i].key != NULL) {
+            *findEntry(newEntries, newCapacity, map->entries[i].key, map->entries[i].hash) = map->entries[i];
+        }
+    }
+    free(map->entries);
+    map->entries = newEntries;
+    map->capacity = newCapacity;
+}
+
+void* hashMapGet(HashMap* map, const char* key) {
+    if (map->entries == NULL) {
+        return NULL;
+    }
+    HashEntry* entry = findEntry(map->entries, map->capacity, key, hashString(key));
+    return entry->key ? entry->value : NULL;
+}
+
+void hashMapPut(HashMap* map, const char* key, void* value) {
+    // Keys are not copied, the caller keeps them alive for the lifetime of the map
+    if ((map->count + 1) * 10 > map->capacity * 7) {
+        growHashMap(map);
+    }
+    unsigned long hash = hashString(key);
+    HashEntry* entry = findEntry(map->entries, map->capacity, key, hash);
+    if (entry->key == NULL) {
+        entry->key = key;
+        entry->hash = hash;
+        map->count++;
+    }
+    entry->value = value;
+}
+
+void hashMapFree(HashMap* map) {
+    free(map->entries);
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
@@ -5,11 +5,20 @@
 #include "graph.h"
 
 char clean[1024];
-GraphNode* tree;
+Graph* tree;
+int errorStatus = 1;  // Exit status for errors, 2 under -q so it can't be mistaken for "out of date"
 
 void exitWithError() {
+    writeTrace();  // Names in the trace point into the graph, write it first
     freeGraph(tree);
-    exit(1);
+    freeStatCache();
+    closeArtifactCache();
+    closeSignatureDatabase();
+    closeGraphCache();
+    freeDepfiles();
+    freePatterns();
+    releaseMakefile();
+    exit(errorStatus);
 }
 
 int main(int argc, char* argv[]) {
@@ -17,6 +26,15 @@ int main(int argc, char* argv[]) {
     char* makefile = "myMakefile"; 
     char* target = NULL;           
     int f_flag = 0;                 
+    int jobs = 1;                   // Number of recipes allowed to run at once
+    int debug = 0;                  // Print cache statistics at the end
+    int dryRun = 0;                 // -n: print the recipes that would run
+    int question = 0;               // -q: only report through the exit status
+    int server = 0;                 // --server: stay resident and answer clients
+    int client = 0;                 // --client: ask the running server instead
+    int clientBuild = 0;            // --build: have the server run the build
+    char* cacheDirectory = NULL;    // --cache=DIR: reuse outputs from the artifact cache
+    long long cacheMegabytes = 1024;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-f") == 0) {
@@ -34,6 +52,56 @@ int main(int argc, char* argv[]) {
                 exitWithError();
             }
         }
+        else if (strcmp(argv[i], "-d") == 0) {
+            debug = 1;
+        }
+        else if (strcmp(argv[i], "-n") == 0) {
+            dryRun = 1;
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            question = 1;
+            errorStatus = 2;
+        }
+        else if (strcmp(argv[i], "--server") == 0) {
+            server = 1;
+        }
+        else if (strcmp(argv[i], "--client") == 0) {
+            client = 1;
+        }
+        else if (strcmp(argv[i], "--build") == 0) {
+            clientBuild = 1;
+        }
+        else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            cacheDirectory = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+            cacheMegabytes = atoll(argv[i] + 13);
+            if (cacheMegabytes < 1) {
+                fprintf(stderr, "Error: Invalid cache size %s\n", argv[i] + 13);
+                exitWithError();
+            }
+        }
+        else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            startTrace(argv[i] + 8);
+        }
+        else if (strcmp(argv[i], "-H") == 0) {
+            useSignatures = 1;  // Rebuild on content changes instead of mtimes
+        }
+        else if (strncmp(argv[i], "-j", 2) == 0) {
+            char* count = argv[i] + 2;  // Accept both -j4 and -j 4
+            if (*count == '\0') {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Error: No job count specified after -j\n");
+                    exitWithError();
+                }
+                count = argv[++i];
+            }
+            jobs = atoi(count);
+            if (jobs < 1) {
+                fprintf(stderr, "Error: Invalid job count %s\n", count);
+                exitWithError();
+            }
+        }
         else {
             if (target) { 
                 fprintf(stderr, "Error: More than one target specified\n");
@@ -43,50 +111,104 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (client) {
+        return runClient(makefile, target, clientBuild);
+    }
+
     if (target != NULL && (strcmp(target, "clean") == 0 || strcmp(target, "clear") == 0)) {
 
-        executeShellCommand(clean);
+        executeShellCommand("clean", clean);
+        writeTrace();
         return 0;
     }
 
-    GraphNode* graph = (GraphNode*)malloc(sizeof(GraphNode));
+    Graph graph;
+    initGraph(&graph);
+    tree = &graph;
 
-    if (!graph) {
-        fprintf(stderr, "Failed to allocate memory for the graph.\n");
-        return 1;
-    }
-    graph->name = strdup("main");  // Assuming 'main' is the root node name
-    graph->firstChild = NULL;
-    graph->right = NULL;
-    graph->parent = NULL;
-    graph->commands = NULL;
-    graph->isPointerNode = 0;
-    graph->originalNode = NULL;
-    graph->printed = 0;
-
-    tree = graph;
-
-    if (!target) {  
-        
-        target = readInputFromFile(makefile, &graph, 0);
+    // Reuse the compiled graph from the last run if the makefile is unchanged
+    char* firstTarget = NULL;
+    int64_t start = traceNow();
+    if (loadGraphCache(makefile, &graph, &firstTarget)) {
+        traceSpan("load graph cache", "parse", NULL, start, 0, TRACE_NO_STATUS);
     }
     else {
-        readInputFromFile(makefile, &graph, 1);
+        firstTarget = readInputFromFile(makefile, &graph, 0);
+        finalizeGraph(&graph);
+        traceSpan("readInputFromFile", "parse", NULL, start, 0, TRACE_NO_STATUS);
+        writeGraphCache(makefile, &graph, firstTarget);
+    }
+    if (!target) {
+        target = firstTarget;
+    }
+    start = traceNow();
+    // The server answers for any target, so it needs every pattern match up front
+    if (instantiatePatterns(&graph, server ? NULL : target) > 0) {
+        finalizeGraph(&graph);
+    }
+    if (loadDepfiles(&graph) > 0) {
+        finalizeGraph(&graph);  // Header edges from the compiler's .d files
+    }
+    int cycles = reportCycles(&graph, server ? NULL : target);  // Only cycles the build would reach are fatal
+    traceSpan("resolve graph", "graph", NULL, start, 0, TRACE_NO_STATUS);
+    if (cycles > 0) {
+        exitWithError();
+    }
+
+    // The artifact cache is keyed by the same content signatures as -H.
+    // -n and -q run nothing, so they must not record anything either
+    if (useSignatures || cacheDirectory) {
+        openSignatureDatabase(makefile, dryRun || question);
+    }
+    if (cacheDirectory) {
+        openArtifactCache(cacheDirectory, cacheMegabytes * 1024 * 1024);
     }
 
     // Find the target node and print its subtree
-    GraphNode* targetNode = searchNode(graph, target, NULL);
-    if (targetNode) {
-        printSubtree(targetNode);
+    int targetNode = target ? lookupNode(&graph, target) : -1;
+    int status = 0;
+    start = traceNow();
+    if (targetNode != -1 && server) {
+        runServer(&graph, makefile, targetNode, jobs, argv);
+    }
+    else if (targetNode != -1 && (dryRun || question)) {
+        // Nothing runs, -q stops at the first target that is out of date
+        int outOfDate = checkSubtree(&graph, targetNode, !question);
+        status = (question && outOfDate > 0) ? 1 : 0;
+    }
+    else if (targetNode != -1 && jobs > 1) {
+        buildParallel(&graph, targetNode, jobs);
+    }
+    else if (targetNode != -1) {
+        printSubtree(&graph, targetNode);
     }
     else {
         fprintf(stderr, "Target '%s' not found in the graph.\n", target);
         exitWithError();
     }
-    freeGraph(graph);
-
-
-    return 0;
+    traceSpan("build", "build", target, start, 0, TRACE_NO_STATUS);
+    if (debug) {
+        fprintf(stderr, "stat cache: %ld lookups, %ld stat calls, %ld saved\n",
+            statLookups, statCalls, statLookups - statCalls);
+        fprintf(stderr, "graph arena: %zu allocations, %zu bytes used, %zu bytes peak\n",
+            graphArena.allocations, graphArena.usedBytes, graphArena.peakBytes);
+        fprintf(stderr, "depfiles: %ld read, %ld edges added\n", depfilesRead, depfileEdges);
+        fprintf(stderr, "pattern rules: %ld targets matched\n", patternTargets);
+        if (useArtifactCache) {
+            fprintf(stderr, "artifact cache: %ld hits, %ld misses\n", artifactHits, artifactMisses);
+        }
+    }
+    writeTrace();
+    freeGraph(&graph);
+    freeStatCache();
+    closeArtifactCache();
+    closeSignatureDatabase();
+    closeGraphCache();
+    freeDepfiles();
+    freePatterns();
+    releaseMakefile();
+
+    return status;
 }
 
 
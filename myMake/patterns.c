@@ -0,0 +1,362 @@
+// patterns.c
+// Pattern rules ("%.o: %.c") and the automatic variables $@, $< and $^.
+//
+// A pattern rule is parsed like any other rule: a node named after the
+// target pattern, with edges to the prerequisite patterns, which
+// defineTarget also lists in graph->patterns. Nothing is instantiated while
+// parsing. instantiatePatterns walks from the goal, and every reachable
+// target without a recipe of its own gets the first pattern rule, in
+// makefile order, that matches its name and whose prerequisites exist or
+// are mentioned in the makefile. The target shares the rule's recipe list
+// and gets its prerequisites with the stem substituted, ahead of the ones it
+// listed itself, so $< is the pattern's first prerequisite as in make.
+//
+// Recipe lines that use automatic variables are split into literal pieces
+// and variables when they are added, so expanding one only copies bytes
+// into a buffer that is reused from line to line. "$$" is left alone for
+// the shell, as before.
+#include "graph.h"
+
+long patternTargets = 0;
+
+static char* expansion = NULL;      // Last line expandCommand returned
+static size_t expansionCapacity = 0;
+static int* listedIn = NULL;        // $^ expansion a node was last listed in
+static int listedCapacity = 0;
+static int expansions = 0;
+
+static int isAutomaticVariable(const char* p) {
+    return p[0] == '$' && (p[1] == '@' || p[1] == '<' || p[1] == '^');
+}
+
+// Cuts a recipe line into parts. Returns the number of parts; with parts
+// NULL it only counts them.
+static int splitParts(const char* line, CommandPart* parts) {
+    const char* literal = line;
+    int count = 0;
+    for (const char* p = line; *p; p++) {
+        if (p[0] == '$' && p[1] == '$') {
+            p++;  // An escaped dollar sign, for the shell
+            continue;
+        }
+        if (!isAutomaticVariable(p)) {
+            continue;
+        }
+        if (p > literal) {
+            if (parts) {
+                parts[count] = (CommandPart){ literal, (int)(p - literal), 0 };
+            }
+            count++;
+        }
+        if (parts) {
+            parts[count] = (CommandPart){ NULL, 0, p[1] };
+        }
+        count++;
+        literal = ++p + 1;
+    }
+    if (count > 0 && *literal) {
+        if (parts) {
+            parts[count] = (CommandPart){ literal, (int)strlen(literal), 0 };
+        }
+        count++;
+    }
+    return count;
+}
+
+void splitCommand(CommandNode* command) {
+    int count = splitParts(command->command, NULL);
+    if (count == 0) {
+        return;  // Nothing to expand, the line is run as it is
+    }
+    command->parts = (CommandPart*)arenaAlloc(&graphArena, count * sizeof(CommandPart));
+    command->numParts = splitParts(command->command, command->parts);
+}
+
+static size_t appendText(size_t length, const char* text, size_t size) {
+    if (length + size + 1 > expansionCapacity) {
+        expansionCapacity = expansionCapacity ? expansionCapacity : 4096;
+        while (length + size + 1 > expansionCapacity) {
+            expansionCapacity *= 2;
+        }
+        expansion = (char*)realloc(expansion, expansionCapacity);
+        if (!expansion) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+    }
+    memcpy(expansion + length, text, size);
+    return length + size;
+}
+
+// Prerequisites of the target, each listed once, separated by spaces
+static size_t appendPrereqs(Graph* graph, int target, size_t length) {
+    if (graph->numNodes > listedCapacity) {
+        listedIn = (int*)realloc(listedIn, graph->numNodes * sizeof(int));
+        if (!listedIn) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        memset(listedIn + listedCapacity, 0, (graph->numNodes - listedCapacity) * sizeof(int));
+        listedCapacity = graph->numNodes;
+    }
+    expansions++;
+    int first = 1;
+    for (int e = graph->prereqStart[target]; e < graph->prereqStart[target + 1]; e++) {
+        int prereq = graph->prereqs[e];
+        if (listedIn[prereq] == expansions) {
+            continue;
+        }
+        listedIn[prereq] = expansions;
+        if (!first) {
+            length = appendText(length, " ", 1);
+        }
+        const char* name = graph->nodes[prereq].name;
+        length = appendText(length, name, strlen(name));
+        first = 0;
+    }
+    return length;
+}
+
+// The recipe line with its automatic variables replaced. The result is only
+// valid until the next call.
+const char* expandCommand(Graph* graph, int target, CommandNode* command) {
+    if (!command->parts) {
+        return command->command;
+    }
+    GraphNode* node = &graph->nodes[target];
+    size_t length = 0;
+    for (int i = 0; i < command->numParts; i++) {
+        CommandPart* part = &command->parts[i];
+        if (part->variable == 0) {
+            length = appendText(length, part->text, part->length);
+        }
+        else if (part->variable == '@') {
+            length = appendText(length, node->name, strlen(node->name));
+        }
+        else if (part->variable == '<' && graph->prereqStart[target] < graph->prereqStart[target + 1]) {
+            const char* name = graph->nodes[graph->prereqs[graph->prereqStart[target]]].name;
+            length = appendText(length, name, strlen(name));
+        }
+        else if (part->variable == '^') {
+            length = appendPrereqs(graph, target, length);
+        }
+    }
+    appendText(length, "", 1);
+    return expansion;
+}
+
+// The stem if name matches the pattern, NULL if it does not
+static const char* matchPattern(const char* pattern, const char* name, size_t* stemLength) {
+    const char* percent = strchr(pattern, '%');
+    size_t prefix = percent - pattern, suffix = strlen(percent + 1), length = strlen(name);
+    if (length <= prefix + suffix || strncmp(name, pattern, prefix) != 0
+        || strcmp(name + length - suffix, percent + 1) != 0) {
+        return NULL;
+    }
+    *stemLength = length - prefix - suffix;
+    return name + prefix;
+}
+
+// Writes pattern with its '%' replaced by the stem. Returns 0 if it does not fit.
+static int substituteStem(char* out, size_t size, const char* pattern, const char* stem, size_t stemLength) {
+    const char* percent = strchr(pattern, '%');
+    if (!percent) {
+        return snprintf(out, size, "%s", pattern) < (int)size;
+    }
+    return snprintf(out, size, "%.*s%.*s%s", (int)(percent - pattern), pattern,
+        (int)stemLength, stem, percent + 1) < (int)size;
+}
+
+// 1 if name is what the pattern becomes with the stem substituted
+static int isSubstitution(const char* name, const char* pattern, const char* stem, size_t stemLength) {
+    const char* percent = strchr(pattern, '%');
+    if (!percent) {
+        return strcmp(name, pattern) == 0;
+    }
+    size_t prefix = percent - pattern;
+    return strncmp(name, pattern, prefix) == 0 && strncmp(name + prefix, stem, stemLength) == 0
+        && strcmp(name + prefix + stemLength, percent + 1) == 0;
+}
+
+// First pattern rule that can build name, -1 if there is none
+static int findPatternRule(Graph* graph, const char* name) {
+    char path[4096];
+    for (int i = 0; i < graph->numPatterns; i++) {
+        int rule = graph->patterns[i];
+        size_t stemLength;
+        const char* stem = matchPattern(graph->nodes[rule].name, name, &stemLength);
+        if (!graph->nodes[rule].commands || !stem) {
+            continue;
+        }
+        int usable = 1;
+        for (int e = graph->prereqStart[rule]; e < graph->prereqStart[rule + 1] && usable; e++) {
+            struct stat info;
+            usable = substituteStem(path, sizeof(path), graph->nodes[graph->prereqs[e]].name, stem, stemLength)
+                && (lookupNode(graph, path) != -1 || cachedStat(path, &info) == 0);
+        }
+        if (usable) {
+            return rule;
+        }
+    }
+    return -1;
+}
+
+// Appends id to the walk unless it has been there already
+static void visit(int id, int** stack, int* depth, int* capacity, char** seen, int* seenCapacity) {
+    if (id >= *seenCapacity) {
+        int grown = *seenCapacity * 2;
+        while (grown <= id) {
+            grown *= 2;
+        }
+        *seen = (char*)realloc(*seen, grown);
+        if (!*seen) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        memset(*seen + *seenCapacity, 0, grown - *seenCapacity);
+        *seenCapacity = grown;
+    }
+    if ((*seen)[id]) {
+        return;
+    }
+    (*seen)[id] = 1;
+    if (*depth == *capacity) {
+        *capacity *= 2;
+        *stack = (int*)realloc(*stack, *capacity * sizeof(int));
+        if (!*stack) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+    }
+    (*stack)[(*depth)++] = id;
+}
+
+// Moves the prerequisites a matched target listed itself behind the ones
+// its pattern added, and drops those the pattern already supplies.
+static void orderPatternEdges(Graph* graph, int listedEdges) {
+    if (graph->mapped) {
+        detachGraph(graph);  // Matches added recipes but no edges, the edge list is not built yet
+    }
+    int* from = (int*)malloc(graph->edgeCapacity * sizeof(int));
+    int* to = (int*)malloc(graph->edgeCapacity * sizeof(int));
+    if (!from || !to) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    int count = 0;
+    for (int e = 0; e < graph->numEdges; e++) {
+        if (e >= listedEdges || !graph->nodes[graph->edgeFrom[e]].patternRule) {
+            from[count] = graph->edgeFrom[e];
+            to[count++] = graph->edgeTo[e];
+        }
+    }
+    for (int e = 0; e < listedEdges; e++) {
+        GraphNode* node = &graph->nodes[graph->edgeFrom[e]];
+        if (!node->patternRule) {
+            continue;
+        }
+        int rule = node->patternRule - 1;
+        size_t stemLength;
+        const char* stem = matchPattern(graph->nodes[rule].name, node->name, &stemLength);
+        const char* name = graph->nodes[graph->edgeTo[e]].name;
+        int duplicate = 0;
+        for (int p = graph->prereqStart[rule]; p < graph->prereqStart[rule + 1] && !duplicate; p++) {
+            duplicate = isSubstitution(name, graph->nodes[graph->prereqs[p]].name, stem, stemLength);
+        }
+        if (duplicate) {
+            node->numPrereqs--;
+            continue;
+        }
+        from[count] = graph->edgeFrom[e];
+        to[count++] = graph->edgeTo[e];
+    }
+    free(graph->edgeFrom);
+    free(graph->edgeTo);
+    graph->edgeFrom = from;
+    graph->edgeTo = to;
+    graph->numEdges = count;
+}
+
+// Gives pattern recipes to the targets reachable from the goal, or to every
+// target when goalName is NULL (the server answers for any of them). The
+// goal itself may be a file the makefile never mentions. Needs a finalized
+// graph. Returns the number of targets matched; the caller has to finalize
+// the graph again if it is nonzero.
+int instantiatePatterns(Graph* graph, const char* goalName) {
+    if (graph->numPatterns == 0) {
+        return 0;
+    }
+    int finalizedNodes = graph->numNodes;  // Nodes the adjacency arrays cover
+    int listedEdges = graph->numEdges;
+    long matchedBefore = patternTargets;
+    char path[4096];
+
+    int depth = 0, capacity = 1024, seenCapacity = 1024;
+    int* stack = (int*)malloc(capacity * sizeof(int));
+    char* seen = (char*)calloc(seenCapacity, 1);
+    if (!stack || !seen) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    if (goalName == NULL) {
+        for (int id = 0; id < finalizedNodes; id++) {
+            visit(id, &stack, &depth, &capacity, &seen, &seenCapacity);
+        }
+    }
+    else {
+        int goal = lookupNode(graph, goalName);
+        if (goal == -1 && findPatternRule(graph, goalName) != -1) {
+            goal = findOrCreateNode(graph, (char*)goalName);
+        }
+        if (goal != -1) {
+            visit(goal, &stack, &depth, &capacity, &seen, &seenCapacity);
+        }
+    }
+
+    while (depth > 0) {
+        int id = stack[--depth];
+        if (id < finalizedNodes) {
+            for (int e = graph->prereqStart[id]; e < graph->prereqStart[id + 1]; e++) {
+                visit(graph->prereqs[e], &stack, &depth, &capacity, &seen, &seenCapacity);
+            }
+        }
+        if (graph->nodes[id].commands || strchr(graph->nodes[id].name, '%')) {
+            continue;  // Has a recipe, or is a pattern itself
+        }
+        int rule = findPatternRule(graph, graph->nodes[id].name);
+        if (rule == -1) {
+            continue;
+        }
+        graph->nodes[id].commands = graph->nodes[rule].commands;
+        graph->nodes[id].patternRule = rule + 1;
+        patternTargets++;
+
+        size_t stemLength;
+        const char* stem = matchPattern(graph->nodes[rule].name, graph->nodes[id].name, &stemLength);
+        for (int e = graph->prereqStart[rule]; e < graph->prereqStart[rule + 1]; e++) {
+            substituteStem(path, sizeof(path), graph->nodes[graph->prereqs[e]].name, stem, stemLength);
+            int prereq = lookupNode(graph, path);
+            if (prereq == -1) {
+                prereq = findOrCreateNode(graph, arenaStrdup(&graphArena, path));
+            }
+            addEdge(graph, id, prereq);
+            visit(prereq, &stack, &depth, &capacity, &seen, &seenCapacity);
+        }
+    }
+    free(stack);
+    free(seen);
+
+    if (patternTargets > matchedBefore) {
+        orderPatternEdges(graph, listedEdges);
+    }
+    return (int)(patternTargets - matchedBefore);
+}
+
+void freePatterns() {
+    free(expansion);
+    free(listedIn);
+    expansion = NULL;
+    expansionCapacity = 0;
+    listedIn = NULL;
+    listedCapacity = 0;
+}
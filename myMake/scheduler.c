@@ -0,0 +1,205 @@
+// scheduler.c
+// Parallel (-j N) build: every node reachable from the goal counts its
+// unfinished prerequisites, and a node is dispatched once that count drops
+// to zero. Each node is queued exactly once, so a prerequisite shared by
+// several targets is built exactly once.
+#include <sys/wait.h>
+#include "graph.h"
+
+typedef struct JobSlot {
+    pid_t pid;                  // 0 when the slot is free
+    int node;
+    CommandNode* nextCommand;   // Recipe line to run once the current one finishes
+    CommandNode* command;       // Recipe line running now and when it started, for --trace
+    int64_t start;
+} JobSlot;
+
+// Collects every node reachable from the goal and sets up the pending
+// counts. Returns the number of nodes found.
+static int collectNodes(Graph* graph, int goal, int** nodesOut) {
+    int* nodes = (int*)malloc(graph->numNodes * sizeof(int));
+    if (!nodes) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    int count = 0;
+
+    graph->nodes[goal].scheduled = 1;
+    nodes[count++] = goal;
+    for (int i = 0; i < count; i++) {
+        int id = nodes[i];
+        graph->nodes[id].pendingPrereqs = graph->prereqStart[id + 1] - graph->prereqStart[id];
+        for (int e = graph->prereqStart[id]; e < graph->prereqStart[id + 1]; e++) {
+            int prereq = graph->prereqs[e];
+            if (!graph->nodes[prereq].scheduled) {
+                graph->nodes[prereq].scheduled = 1;
+                nodes[count++] = prereq;
+            }
+        }
+    }
+    *nodesOut = nodes;
+    return count;
+}
+
+// Marks a node as built and queues the dependents it was the last prerequisite of
+static void finishNode(Graph* graph, int id, int* ready, int* readyTail) {
+    for (int e = graph->dependentStart[id]; e < graph->dependentStart[id + 1]; e++) {
+        GraphNode* dependent = &graph->nodes[graph->dependents[e]];
+        // Dependents outside the goal's subgraph are not part of this build
+        if (dependent->scheduled && --dependent->pendingPrereqs == 0) {
+            ready[(*readyTail)++] = graph->dependents[e];
+        }
+    }
+}
+
+static pid_t launchCommand(Graph* graph, JobSlot* slot, CommandNode* command) {
+    const char* line = expandCommand(graph, slot->node, command);
+    printf("%s\n", line);
+    slot->command = command;
+    slot->start = traceNow();
+    pid_t pid = spawnCommand(line);
+    if (pid < 0) {
+        fprintf(stderr, "Command failed to execute\n");
+    }
+    return pid;
+}
+
+static void waitForRunningJobs(JobSlot* slots, int maxJobs) {
+    for (int i = 0; i < maxJobs; i++) {
+        if (slots[i].pid > 0) {
+            waitpid(slots[i].pid, NULL, 0);
+            slots[i].pid = 0;
+        }
+    }
+}
+
+void buildParallel(Graph* graph, int goal, int maxJobs) {
+    int* nodes;
+    int numNodes = collectNodes(graph, goal, &nodes);
+
+    // Every node enters the ready queue exactly once, so a flat array is enough
+    int* ready = (int*)malloc(numNodes * sizeof(int));
+    if (!ready) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    int readyHead = 0, readyTail = 0;
+    for (int i = 0; i < numNodes; i++) {
+        if (graph->nodes[nodes[i]].pendingPrereqs == 0) {
+            ready[readyTail++] = nodes[i];
+        }
+    }
+
+    JobSlot* slots = (JobSlot*)calloc(maxJobs, sizeof(JobSlot));
+    if (!slots) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    int running = 0, finished = 0, failed = 0;
+
+    while (!failed) {
+        // Dispatch as many ready targets as there are free slots
+        while (running < maxJobs && readyHead < readyTail) {
+            int id = ready[readyHead++];
+            GraphNode* node = &graph->nodes[id];
+
+            int64_t start = traceNow();
+            initializeGraphNode(node);
+            int rebuild = needsRebuild(graph, id);
+            traceSpan("up-to-date check", "stat", node->name, start, 0, TRACE_NO_STATUS);
+            if (!rebuild) {
+                // Up to date, release the dependents straight away
+                finished++;
+                finishNode(graph, id, ready, &readyTail);
+                continue;
+            }
+            if (!node->commands) {
+                fprintf(stderr, "File not found and not a target: %s\n", node->name);
+                failed = 1;
+                break;
+            }
+            if (useArtifactCache && restoreArtifact(graph, id)) {
+                markBuilt(node);
+                finished++;
+                finishNode(graph, id, ready, &readyTail);
+                continue;
+            }
+
+            int slot = 0;
+            while (slots[slot].pid != 0) {
+                slot++;
+            }
+            slots[slot].node = id;
+            slots[slot].nextCommand = node->commands->next;
+            slots[slot].pid = launchCommand(graph, &slots[slot], node->commands);
+            if (slots[slot].pid < 0) {
+                slots[slot].pid = 0;
+                failed = 1;
+                break;
+            }
+            running++;
+        }
+        if (failed || running == 0) {
+            break;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            continue;  // Interrupted, try again
+        }
+        int slot = 0;
+        while (slot < maxJobs && slots[slot].pid != pid) {
+            slot++;
+        }
+        if (slot == maxJobs) {
+            continue;  // Not one of ours
+        }
+        slots[slot].pid = 0;
+        running--;
+
+        // Lane 0 is the scheduler itself, each job slot gets a lane of its own
+        // The expansion buffer has been reused since the launch, expand the line again
+        traceSpan(expandCommand(graph, slots[slot].node, slots[slot].command), "recipe", graph->nodes[slots[slot].node].name, slots[slot].start,
+            slot + 1, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Command failed to execute\n");
+            failed = 1;
+            break;
+        }
+
+        if (slots[slot].nextCommand) {
+            // Recipe lines of one target still run one after another
+            CommandNode* command = slots[slot].nextCommand;
+            slots[slot].nextCommand = command->next;
+            slots[slot].pid = launchCommand(graph, &slots[slot], command);
+            if (slots[slot].pid < 0) {
+                slots[slot].pid = 0;
+                failed = 1;
+                break;
+            }
+            running++;
+            continue;
+        }
+
+        markBuilt(&graph->nodes[slots[slot].node]);
+        if (useArtifactCache) {
+            storeArtifact(&graph->nodes[slots[slot].node]);
+        }
+        finished++;
+        finishNode(graph, slots[slot].node, ready, &readyTail);
+    }
+
+    if (!failed && finished < numNodes) {
+        fprintf(stderr, "Circular dependency detected while building %s\n", graph->nodes[goal].name);
+        failed = 1;
+    }
+
+    waitForRunningJobs(slots, maxJobs);
+    free(slots);
+    free(ready);
+    free(nodes);
+    if (failed) {
+        exitWithError();
+    }
+}
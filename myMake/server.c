@@ -0,0 +1,481 @@
+// server.c
+// Resident build server (--server) and its client (--client).
+//
+// The server parses the makefile once and keeps the graph, the stat cache
+// and an up-to-date status for every node in memory. inotify tells it which
+// files changed; a change marks that node and everything depending on it
+// (found through the dependents CSR) as unknown. Every other node keeps its
+// status, so a query only re-examines what changed since the last one:
+//   - a fresh node is up to date together with everything below it, and is
+//     never descended into;
+//   - under a stale node everything is known, so listing the stale targets
+//     costs one visit per stale node.
+// Nodes in directories that can't be watched are re-checked on every query.
+//
+// Protocol, over the Unix socket <makefile>.sock: the client sends one line,
+// "stale <target>" or "build <target>" (an empty target means the default
+// goal). The server answers with free text, then a NUL byte, then the exit
+// status in decimal. "stale" lists the out-of-date targets in build order.
+// "build" forks a child that inherits the warm state and runs the build
+// with its output going straight to the client.
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "graph.h"
+
+#define STATUS_UNKNOWN 0
+#define STATUS_FRESH 1
+#define STATUS_STALE 2
+#define STATUS_MISSING 3   // Out of date and there is no recipe to make it
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+typedef struct Server {
+    Graph* graph;
+    const char* makefile;
+    const char* makefileName;   // Makefile without its directory, as inotify reports it
+    int makefileWatch;          // Watch on the makefile's directory
+    int defaultGoal;
+    int jobs;
+
+    char* status;               // STATUS_* per node
+    char* watched;              // 1 if inotify covers the node's directory
+    unsigned* visited;          // Query generation that last visited the node
+    unsigned generation;
+    int* stackNode;             // DFS stack shared by invalidation and queries
+    int* stackEdge;
+    int* order;                 // Nodes visited by the current query, in build order
+
+    char** prefixes;            // Directory prefix of each watch descriptor
+    int numPrefixes;
+    int inotifyFd;
+} Server;
+
+static void socketPath(const char* makefile, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (snprintf(address->sun_path, sizeof(address->sun_path), "%s.sock", makefile)
+        >= (int)sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path for %s is too long.\n", makefile);
+        exitWithError();
+    }
+}
+
+static void sendText(int fd, const char* text, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, text, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return;  // Client went away, nothing left to tell it
+        }
+        text += sent;
+        length -= sent;
+    }
+}
+
+static void sendStatus(int fd, int status) {
+    char line[32];
+    int length = snprintf(line, sizeof(line), "%c%d", '\0', status);
+    sendText(fd, line, length);
+}
+
+// Marks a node and everything that depends on it as unknown
+static void invalidateNode(Server* server, int id) {
+    Graph* graph = server->graph;
+    invalidateStat(graph->nodes[id].name);
+    if (server->status[id] == STATUS_UNKNOWN) {
+        return;  // Its dependents are unknown already
+    }
+    int depth = 0;
+    server->status[id] = STATUS_UNKNOWN;
+    server->stackNode[depth++] = id;
+    while (depth > 0) {
+        int current = server->stackNode[--depth];
+        for (int e = graph->dependentStart[current]; e < graph->dependentStart[current + 1]; e++) {
+            int dependent = graph->dependents[e];
+            if (server->status[dependent] != STATUS_UNKNOWN) {
+                server->status[dependent] = STATUS_UNKNOWN;
+                server->stackNode[depth++] = dependent;
+            }
+        }
+    }
+}
+
+static void invalidateAll(Server* server) {
+    memset(server->status, STATUS_UNKNOWN, server->graph->numNodes);
+    freeStatCache();
+}
+
+// Records the directory prefix of watch descriptor wd
+static void setPrefix(Server* server, int wd, const char* prefix) {
+    if (wd >= server->numPrefixes) {
+        int count = wd + 64;
+        char** prefixes = (char**)realloc(server->prefixes, count * sizeof(char*));
+        if (!prefixes) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        memset(prefixes + server->numPrefixes, 0, (count - server->numPrefixes) * sizeof(char*));
+        server->prefixes = prefixes;
+        server->numPrefixes = count;
+    }
+    server->prefixes[wd] = strdup(prefix);
+    if (!server->prefixes[wd]) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+}
+
+// Watches the directory of every node, once per directory
+static void watchDirectories(Server* server) {
+    Graph* graph = server->graph;
+    HashMap directories;
+    hashMapInit(&directories, 64);
+
+    for (int id = 0; id < graph->numNodes; id++) {
+        const char* name = graph->nodes[id].name;
+        const char* slash = strrchr(name, '/');
+        size_t length = slash ? (size_t)(slash - name) + 1 : 0;
+        char* prefix = (char*)malloc(length + 1);
+        if (!prefix) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        memcpy(prefix, name, length);
+        prefix[length] = '\0';
+
+        intptr_t known = (intptr_t)hashMapGet(&directories, prefix);
+        if (known != 0) {
+            server->watched[id] = known > 0;
+            free(prefix);
+            continue;
+        }
+        int wd = inotify_add_watch(server->inotifyFd, length ? prefix : ".", WATCH_EVENTS);
+        hashMapPut(&directories, prefix, (void*)(intptr_t)(wd >= 0 ? 1 : -1));
+        server->watched[id] = wd >= 0;
+        if (wd < 0) {
+            fprintf(stderr, "Not watching %s, targets in it are checked on every query\n", length ? prefix : ".");
+            continue;
+        }
+        setPrefix(server, wd, prefix);
+    }
+
+    // The map owns the prefix strings, the watch table has its own copies
+    for (size_t i = 0; i < directories.capacity; i++) {
+        free((char*)directories.entries[i].key);
+    }
+    hashMapFree(&directories);
+}
+
+// Reads every pending inotify event. Returns 1 if the makefile or one of the
+// depfiles changed.
+static int drainEvents(Server* server) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[4096];
+    int makefileChanged = 0;
+
+    for (;;) {
+        ssize_t length = read(server->inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return makefileChanged;  // EAGAIN, nothing left
+        }
+        for (char* p = buffer; p < buffer + length;) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                invalidateAll(server);  // Events were lost, trust nothing
+                continue;
+            }
+            if (event->len == 0 || event->wd < 0 || event->wd >= server->numPrefixes
+                || server->prefixes[event->wd] == NULL) {
+                continue;
+            }
+            if (event->wd == server->makefileWatch && strcmp(event->name, server->makefileName) == 0) {
+                makefileChanged = 1;
+            }
+            snprintf(path, sizeof(path), "%s%s", server->prefixes[event->wd], event->name);
+            if (isDepfile(path)) {
+                makefileChanged = 1;  // New header edges, the graph has to be rebuilt
+            }
+            int id = lookupNode(server->graph, path);
+            if (id != -1) {
+                invalidateNode(server, id);
+            }
+        }
+    }
+}
+
+// Works out the status of every node the goal depends on that isn't known
+// to be fresh, and leaves them in server->order in build order. Returns how
+// many there are.
+static int checkGoal(Server* server, int goal) {
+    Graph* graph = server->graph;
+
+    // Nothing tells us when these change, so they are always re-checked
+    for (int id = 0; id < graph->numNodes; id++) {
+        if (!server->watched[id]) {
+            invalidateNode(server, id);
+        }
+    }
+
+    unsigned generation = ++server->generation;
+    int depth = 0, count = 0;
+    if (server->status[goal] != STATUS_FRESH) {
+        server->visited[goal] = generation;
+        server->stackNode[depth] = goal;
+        server->stackEdge[depth++] = graph->prereqStart[goal];
+    }
+    while (depth > 0) {
+        int current = server->stackNode[depth - 1];
+        if (server->stackEdge[depth - 1] < graph->prereqStart[current + 1]) {
+            int prereq = graph->prereqs[server->stackEdge[depth - 1]++];
+            if (server->status[prereq] != STATUS_FRESH && server->visited[prereq] != generation) {
+                server->visited[prereq] = generation;
+                server->stackNode[depth] = prereq;
+                server->stackEdge[depth++] = graph->prereqStart[prereq];
+            }
+            continue;
+        }
+        depth--;
+        server->order[count++] = current;
+        if (server->status[current] != STATUS_UNKNOWN) {
+            continue;
+        }
+
+        // Every prerequisite is settled, the same rule as checkSubtree
+        GraphNode* node = &graph->nodes[current];
+        int outOfDate = 0;
+        for (int e = graph->prereqStart[current]; e < graph->prereqStart[current + 1]; e++) {
+            if (server->status[graph->prereqs[e]] >= STATUS_STALE) {
+                outOfDate = 1;
+                break;
+            }
+        }
+        if (!outOfDate) {
+            initializeGraphNode(node);
+            outOfDate = needsRebuild(graph, current);
+        }
+        if (!outOfDate) {
+            server->status[current] = STATUS_FRESH;
+        }
+        else {
+            server->status[current] = node->commands ? STATUS_STALE : STATUS_MISSING;
+        }
+    }
+    return count;
+}
+
+static void answerStale(Server* server, int client, int goal) {
+    int count = checkGoal(server, goal);
+    int status = 0;
+    char line[4096];
+    for (int i = 0; i < count; i++) {
+        int id = server->order[i];
+        const char* name = server->graph->nodes[id].name;
+        int length = 0;
+        if (server->status[id] == STATUS_STALE) {
+            length = snprintf(line, sizeof(line), "%s\n", name);
+            status = status ? status : 1;
+        }
+        else if (server->status[id] == STATUS_MISSING) {
+            length = snprintf(line, sizeof(line), "File not found and not a target: %s\n", name);
+            status = 2;
+        }
+        sendText(client, line, length < (int)sizeof(line) ? length : (int)sizeof(line) - 1);
+    }
+    sendStatus(client, status);
+}
+
+static void answerBuild(Server* server, int client, int goal) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The child gets a copy of the warm graph and stat cache; recipes and
+        // their output go straight to the client
+        dup2(client, STDOUT_FILENO);
+        dup2(client, STDERR_FILENO);
+        close(client);
+        close(server->inotifyFd);
+        if (server->jobs > 1) {
+            buildParallel(server->graph, goal, server->jobs);
+        }
+        else {
+            printSubtree(server->graph, goal);
+        }
+        fflush(stdout);
+        _exit(0);
+    }
+    int status = 1;
+    if (pid > 0) {
+        int result;
+        while (waitpid(pid, &result, 0) < 0 && errno == EINTR) {
+        }
+        status = (WIFEXITED(result) && WEXITSTATUS(result) == 0) ? 0 : 1;
+    }
+    // Files the build wrote are picked up through inotify before the next query
+    sendStatus(client, status);
+}
+
+static void serveClient(Server* server, int client) {
+    char request[4096];
+    size_t length = 0;
+    while (length + 1 < sizeof(request)) {
+        ssize_t got = recv(client, request + length, sizeof(request) - 1 - length, 0);
+        if (got <= 0) {
+            break;
+        }
+        length += got;
+        if (memchr(request, '\n', length)) {
+            break;
+        }
+    }
+    request[length] = '\0';
+    request[strcspn(request, "\n")] = '\0';
+
+    char* target = strchr(request, ' ');
+    if (target != NULL) {
+        *target++ = '\0';
+    }
+    int goal = (target != NULL && *target != '\0') ? lookupNode(server->graph, target) : server->defaultGoal;
+    if (goal == -1) {
+        char message[4200];
+        int size = snprintf(message, sizeof(message), "Target '%s' not found in the graph.\n", target);
+        sendText(client, message, size);
+        sendStatus(client, 2);
+        return;
+    }
+
+    if (strcmp(request, "stale") == 0) {
+        answerStale(server, client, goal);
+    }
+    else if (strcmp(request, "build") == 0) {
+        answerBuild(server, client, goal);
+    }
+    else {
+        const char* message = "Unknown request\n";
+        sendText(client, message, strlen(message));
+        sendStatus(client, 2);
+    }
+}
+
+void runServer(Graph* graph, const char* makefile, int defaultGoal, int jobs, char* argv[]) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+    server.graph = graph;
+    server.makefile = makefile;
+    server.defaultGoal = defaultGoal;
+    server.jobs = jobs;
+    server.status = (char*)calloc(graph->numNodes + 1, 1);
+    server.watched = (char*)calloc(graph->numNodes + 1, 1);
+    server.visited = (unsigned*)calloc(graph->numNodes + 1, sizeof(unsigned));
+    server.stackNode = (int*)malloc((graph->numNodes + 1) * sizeof(int));
+    server.stackEdge = (int*)malloc((graph->numNodes + 1) * sizeof(int));
+    server.order = (int*)malloc((graph->numNodes + 1) * sizeof(int));
+    if (!server.status || !server.watched || !server.visited || !server.stackNode
+        || !server.stackEdge || !server.order) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+
+    server.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (server.inotifyFd < 0) {
+        fprintf(stderr, "Could not start inotify.\n");
+        exitWithError();
+    }
+    watchDirectories(&server);
+
+    // The makefile's directory is watched too, a new makefile restarts the server
+    const char* slash = strrchr(makefile, '/');
+    server.makefileName = slash ? slash + 1 : makefile;
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%.*s", slash ? (int)(slash - makefile) + 1 : 0, makefile);
+    server.makefileWatch = inotify_add_watch(server.inotifyFd, slash ? directory : ".", WATCH_EVENTS);
+    if (server.makefileWatch >= 0 && (server.makefileWatch >= server.numPrefixes
+        || server.prefixes[server.makefileWatch] == NULL)) {
+        setPrefix(&server, server.makefileWatch, slash ? directory : "");
+    }
+
+    struct sockaddr_un address;
+    socketPath(makefile, &address);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(address.sun_path);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0
+        || listen(listener, 16) != 0) {
+        fprintf(stderr, "Could not listen on %s.\n", address.sun_path);
+        exitWithError();
+    }
+    fprintf(stderr, "Serving %d targets from %s on %s\n", graph->numNodes, makefile, address.sun_path);
+
+    struct pollfd fds[2] = { { listener, POLLIN, 0 }, { server.inotifyFd, POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            fprintf(stderr, "poll failed.\n");
+            exitWithError();
+        }
+        // Always catch up on file changes before answering anyone
+        if (drainEvents(&server)) {
+            fprintf(stderr, "%s or a depfile changed, restarting\n", makefile);
+            close(listener);
+            unlink(address.sun_path);
+            writeTrace();
+            execvp(argv[0], argv);
+            fprintf(stderr, "Could not restart %s.\n", argv[0]);
+            exitWithError();
+        }
+        if (fds[0].revents & POLLIN) {
+            int client = accept(listener, NULL, NULL);
+            if (client >= 0) {
+                serveClient(&server, client);
+                close(client);
+            }
+        }
+    }
+}
+
+int runClient(const char* makefile, const char* target, int build) {
+    struct sockaddr_un address;
+    socketPath(makefile, &address);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "No build server is running for %s (start one with --server).\n", makefile);
+        return 2;
+    }
+
+    char request[4096];
+    int length = snprintf(request, sizeof(request), "%s %s\n", build ? "build" : "stale", target ? target : "");
+    sendText(fd, request, length);
+
+    // Everything before the last NUL is output, the rest is the exit status
+    char buffer[65536];
+    char tail[32];
+    size_t tailLength = 0;
+    int seenNul = 0;
+    ssize_t got;
+    while ((got = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        for (ssize_t i = 0; i < got; i++) {
+            if (seenNul && (buffer[i] == '\0' || tailLength + 1 == sizeof(tail))) {
+                // The last NUL was part of the output after all
+                putchar('\0');
+                fwrite(tail, 1, tailLength, stdout);
+                tailLength = 0;
+                seenNul = 0;
+            }
+            if (buffer[i] == '\0') {
+                seenNul = 1;
+            }
+            else if (seenNul) {
+                tail[tailLength++] = buffer[i];
+            }
+            else {
+                putchar(buffer[i]);
+            }
+        }
+    }
+    close(fd);
+    fflush(stdout);
+    tail[tailLength] = '\0';
+    return seenNul ? atoi(tail) : 2;
+}
@@ -2,198 +2,1724 @@
  * @file shortestPaths.c
  * @brief Implements Dijkstra's shortest path algorithm for a graph.
  * @author Ahmad Gaber
+ *
+ * Vertex names are interned once, on load, into an array of vertices
+ * indexed by an open-addressing hash table, and edges refer to their
+ * destination by index. Dijkstra keeps its frontier in an indexed binary
+ * heap, so a query costs O((V + E) log V) instead of O(V^2).
+ *
+ * Queries go through a QueryEngine, which keeps the searches of the last
+ * few sources. A search stops once the end vertex is settled, and a later
+ * query from the same source reads the settled distance or resumes.
+ *
+ * Two point-to-point modes settle far fewer vertices per query:
+ *   -b  bidirectional Dijkstra, valid because every edge is stored both ways
+ *   -a  A* with ALT lower bounds: distances from a few landmarks, picked
+ *       farthest-first and computed once at load, bound the distance to the
+ *       end through the triangle inequality
+ * -l N sets the number of landmarks, -d prints search statistics to stderr.
+ *
+ * The graph is read from the file named on the command line, input.txt by
+ * default: text with one "src dest dist" edge per line, dist a non-negative
+ * integer, or the binary form -w FILE writes, which is mapped as it is.
+ * Either way it ends up as CSR arrays, 8 bytes per edge entry, with every
+ * name stored once.
+ *
+ * For graphs that answer many queries, -p FILE builds a contraction
+ * hierarchy from the graph and saves it, and -c FILE answers queries from
+ * the saved hierarchy alone, with two upward searches that settle a few
+ * hundred vertices where Dijkstra settles a large part of the graph. The
+ * hierarchy pays off on road-like graphs; on others, contraction stops at a
+ * dense core that queries search in full.
+ *
+ * -t N answers queries on N threads. The graph is read-only once loaded and
+ * every thread searches with its own QueryEngine; queries are read in
+ * batches and the answers printed in input order.
+ *
+ * -s NAME prints the distance from NAME to every vertex it reaches, one
+ * "name dist" line each, computed by delta-stepping on the -t threads.
+ * -D N sets the bucket width, the mean edge length by default.
  */
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <limits.h>
-
-typedef struct Edge {
-    char* dest;
-    int dist;
-    struct Edge* next;
-} Edge;
-
-typedef struct Vertex {
-    char* name;
-    int minDist;
-    int visited;
-    Edge* edges;
-    struct Vertex* next;
-} Vertex;
-
-typedef struct Graph {
-    Vertex* vertices;
-} Graph;
-
-// Function Prototypes
-Graph* initGraph();
-void addVertex(Graph* g, const char* name);
-Vertex* findVertex(Graph* g, const char* name);
-void addEdge(Graph* g, const char* src, const char* dest, int dist);
-void readGraphFromFile(Graph* g, const char* filename);
-void initDijkstra(Graph* g, const char* start);
-Vertex* findMinDistVertex(Graph* g);
-int dijkstra(Graph* g, const char* start, const char* end);
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shortestPaths.h"
 
 /**
  * @brief Initializes a new graph.
  * @return A pointer to the newly initialized graph.
  */
 Graph* initGraph() {
-    Graph* g = (Graph*)malloc(sizeof(Graph));
-    g->vertices = NULL;
+    Graph* g = (Graph*)calloc(1, sizeof(Graph));
+    if (g == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
     return g;
 }
 
 /**
- * @brief Adds a vertex to the graph.
+ * @brief Hashes a vertex name (FNV-1a). Binary graph files store the name
+ *        index built with it, so it must not change without a new magic.
+ * @param name The name of the vertex.
+ * @return The hash of the name.
+ */
+static unsigned long hashName(const char* name) {
+    unsigned long hash = 14695981039346656037UL;
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 1099511628211UL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns the name of a vertex.
+ * @param g The graph.
+ * @param id The vertex.
+ * @return The name, owned by the graph.
+ */
+const char* vertexName(Graph* g, int id) {
+    return g->names + g->nameOffset[id];
+}
+
+/**
+ * @brief Finds the slot holding a name, or the empty slot where it would go.
  * @param g The graph.
  * @param name The name of the vertex.
+ * @return The slot index.
  */
-void addVertex(Graph* g, const char* name) {
-    Vertex* cur = g->vertices;
-    while (cur != NULL) {
-        if (strcmp(cur->name, name) == 0) {
-            return;
+static size_t findSlot(Graph* g, const char* name) {
+    size_t i = hashName(name) & (g->slotCapacity - 1);
+    while (g->slots[i] != -1 && strcmp(vertexName(g, g->slots[i]), name) != 0) {
+        i = (i + 1) & (g->slotCapacity - 1);  // Linear probing
+    }
+    return i;
+}
+
+/**
+ * @brief Doubles the name index and reinserts every vertex.
+ * @param g The graph.
+ */
+static void growSlots(Graph* g) {
+    int capacity = g->slotCapacity ? g->slotCapacity * 2 : 1024;
+    int* slots = (int*)malloc(capacity * sizeof(int));
+    if (slots == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    memset(slots, -1, capacity * sizeof(int));
+    for (int id = 0; id < g->numVertices; id++) {
+        size_t i = hashName(vertexName(g, id)) & (capacity - 1);
+        while (slots[i] != -1) {
+            i = (i + 1) & (capacity - 1);
+        }
+        slots[i] = id;
+    }
+    free(g->slots);
+    g->slots = slots;
+    g->slotCapacity = capacity;
+}
+
+/**
+ * @brief Adds a vertex to the graph, unless it is there already. The name
+ *        is copied once into the graph's name table.
+ * @param g The graph, which must not be mapped from a file.
+ * @param name The name of the vertex.
+ * @return The index of the vertex.
+ */
+int addVertex(Graph* g, const char* name) {
+    if ((g->numVertices + 1) * 10 > g->slotCapacity * 7) {
+        growSlots(g);
+    }
+    size_t slot = findSlot(g, name);
+    if (g->slots[slot] != -1) {
+        return g->slots[slot];
+    }
+    if (g->numVertices == g->vertexCapacity) {
+        g->vertexCapacity = g->vertexCapacity ? g->vertexCapacity * 2 : 1024;
+        g->nameOffset = (int*)realloc(g->nameOffset, g->vertexCapacity * sizeof(int));
+        if (g->nameOffset == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    size_t length = strlen(name) + 1;
+    if (g->nameBytes + (long long)length > g->nameCapacity) {
+        while (g->nameBytes + (long long)length > g->nameCapacity) {
+            g->nameCapacity = g->nameCapacity ? g->nameCapacity * 2 : 16384;
+        }
+        g->names = (char*)realloc(g->names, g->nameCapacity);
+        if (g->names == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
         }
-        cur = cur->next;
     }
-    Vertex* new_vertex = (Vertex*)malloc(sizeof(Vertex));
-    new_vertex->name = strdup(name);
-    new_vertex->minDist = -1;
-    new_vertex->visited = 0;
-    new_vertex->edges = NULL;
-    new_vertex->next = g->vertices;
-    g->vertices = new_vertex;
+    int id = g->numVertices++;
+    g->nameOffset[id] = (int)g->nameBytes;
+    memcpy(g->names + g->nameBytes, name, length);
+    g->nameBytes += length;
+    g->slots[slot] = id;
+    return id;
 }
 
 /**
  * @brief Finds a vertex in the graph by its name.
  * @param g The graph.
  * @param name The name of the vertex.
- * @return A pointer to the vertex if found, NULL otherwise.
+ * @return The index of the vertex if found, -1 otherwise.
  */
-Vertex* findVertex(Graph* g, const char* name) {
-    Vertex* cur = g->vertices;
-    while (cur != NULL) {
-        if (strcmp(cur->name, name) == 0) {
-            return cur;
-        }
-        cur = cur->next;
+int findVertex(Graph* g, const char* name) {
+    if (g->slotCapacity == 0) {
+        return -1;
     }
-    return NULL;
+    return g->slots[findSlot(g, name)];
 }
 
 /**
- * @brief Adds an edge between two vertices in the graph.
+ * @brief Adds an edge between two vertices in the graph, in both directions.
+ *        It is queued until finalizeGraph builds the edge arrays.
  * @param g The graph.
  * @param src The source vertex.
  * @param dest The destination vertex.
  * @param dist The distance between the vertices.
  */
-void addEdge(Graph* g, const char* src, const char* dest, int dist) {
-    Vertex* src_vertex = findVertex(g, src);
-    Vertex* dest_vertex = findVertex(g, dest);
-    if (src_vertex == NULL || dest_vertex == NULL) {
-        return;
+void addEdge(Graph* g, int src, int dest, int dist) {
+    if (g->numNewEdges == g->newEdgeCapacity) {
+        g->newEdgeCapacity = g->newEdgeCapacity ? g->newEdgeCapacity * 2 : 4096;
+        g->newEdgeSrc = (int*)realloc(g->newEdgeSrc, g->newEdgeCapacity * sizeof(int));
+        g->newEdges = (Edge*)realloc(g->newEdges, g->newEdgeCapacity * sizeof(Edge));
+        if (!g->newEdgeSrc || !g->newEdges) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    g->newEdgeSrc[g->numNewEdges] = src;
+    g->newEdges[g->numNewEdges].dest = dest;
+    g->newEdges[g->numNewEdges].dist = dist;
+    g->numNewEdges++;
+}
+
+/**
+ * @brief Builds the edge arrays from the queued edges, with a counting sort
+ *        by source. Called once, after the last addEdge.
+ * @param g The graph.
+ */
+void finalizeGraph(Graph* g) {
+    int n = g->numVertices;
+    g->numEdges = g->numNewEdges * 2;
+    g->edgeStart = (int*)calloc(n + 2, sizeof(int));
+    g->edges = (Edge*)malloc((g->numEdges > 0 ? g->numEdges : 1) * sizeof(Edge));
+    if (!g->edgeStart || !g->edges) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < g->numNewEdges; i++) {
+        g->edgeStart[g->newEdgeSrc[i] + 2]++;
+        g->edgeStart[g->newEdges[i].dest + 2]++;
+    }
+    for (int id = 2; id <= n + 1; id++) {
+        g->edgeStart[id] += g->edgeStart[id - 1];
+    }
+    // edgeStart[v + 1] is the next free entry of v while filling, and its end afterwards
+    for (int i = 0; i < g->numNewEdges; i++) {
+        int src = g->newEdgeSrc[i];
+        int dest = g->newEdges[i].dest;
+        g->edges[g->edgeStart[src + 1]++] = g->newEdges[i];
+        g->edges[g->edgeStart[dest + 1]].dest = src;
+        g->edges[g->edgeStart[dest + 1]++].dist = g->newEdges[i].dist;
+    }
+    free(g->newEdgeSrc);
+    free(g->newEdges);
+    g->newEdgeSrc = NULL;
+    g->newEdges = NULL;
+    g->numNewEdges = 0;
+    g->newEdgeCapacity = 0;
+}
+
+/**
+ * @brief Maps a binary file written by writeGraphFile. Nothing is copied
+ *        or checked beyond the header and the file size, so loading takes
+ *        the same time whatever the size of the graph.
+ * @param g An empty graph, which receives the vertices and edges.
+ * @param filename The name of the file.
+ * @param magic GRAPH_MAGIC or HIERARCHY_MAGIC.
+ */
+static void mapGraphFile(Graph* g, const char* filename, const char* magic) {
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: Could not open file %s\n", filename);
+        exit(1);
+    }
+    GraphFileHeader header;
+    if (info.st_size < (off_t)sizeof(header) || read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, magic, 8) != 0) {
+        fprintf(stderr, "Error: %s is not a %s\n", filename,
+            strcmp(magic, HIERARCHY_MAGIC) == 0 ? "contraction hierarchy" : "binary graph");
+        exit(1);
+    }
+    size_t expected = sizeof(header) + ((size_t)header.numVertices + 1) * sizeof(int) +
+        (size_t)header.numEdges * sizeof(Edge) + (size_t)header.numVertices * sizeof(int) +
+        (size_t)header.slotCapacity * sizeof(int) + (size_t)header.nameBytes;
+    if (header.numVertices < 0 || header.numEdges < 0 || header.nameBytes < 0 ||
+        (size_t)info.st_size != expected) {
+        fprintf(stderr, "Error: %s is truncated\n", filename);
+        exit(1);
+    }
+    char* data = (char*)mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map file %s\n", filename);
+        exit(1);
+    }
+    g->map = data;
+    g->mapSize = info.st_size;
+    g->numVertices = header.numVertices;
+    g->numEdges = header.numEdges;
+    g->slotCapacity = header.slotCapacity;
+    g->nameBytes = header.nameBytes;
+    data += sizeof(header);
+    g->edgeStart = (int*)data;
+    data += ((size_t)g->numVertices + 1) * sizeof(int);
+    g->edges = (Edge*)data;
+    data += (size_t)g->numEdges * sizeof(Edge);
+    g->nameOffset = (int*)data;
+    data += (size_t)g->numVertices * sizeof(int);
+    g->slots = (int*)data;
+    data += (size_t)g->slotCapacity * sizeof(int);
+    g->names = data;
+}
+
+/**
+ * @brief Writes vertex names and edges as a binary file: a GraphFileHeader,
+ *        then edgeStart, the edges, nameOffset, the name index and the
+ *        names, in native byte order, every section 4-byte aligned.
+ * @param g The graph whose names and name index are written.
+ * @param numEdges The number of edges.
+ * @param edgeStart The edge offsets, over g's vertex ids.
+ * @param edges The edges.
+ * @param magic GRAPH_MAGIC or HIERARCHY_MAGIC.
+ * @param filename The name of the file.
+ */
+static void writeGraphFile(Graph* g, int numEdges, const int* edgeStart, const Edge* edges,
+    const char* magic, const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not open file %s for writing\n", filename);
+        exit(1);
+    }
+    GraphFileHeader header = { { 0 } };
+    memcpy(header.magic, magic, 8);
+    header.numVertices = g->numVertices;
+    header.numEdges = numEdges;
+    header.slotCapacity = g->slotCapacity;
+    header.nameBytes = g->nameBytes;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(edgeStart, sizeof(int), g->numVertices + 1, file);
+    fwrite(edges, sizeof(Edge), numEdges, file);
+    fwrite(g->nameOffset, sizeof(int), g->numVertices, file);
+    fwrite(g->slots, sizeof(int), g->slotCapacity, file);
+    fwrite(g->names, 1, g->nameBytes, file);
+    if (ferror(file) | fclose(file)) {
+        fprintf(stderr, "Error: Could not write file %s\n", filename);
+        exit(1);
     }
-    Edge* new_edge = (Edge*)malloc(sizeof(Edge));
-    new_edge->dest = strdup(dest);
-    new_edge->dist = dist;
-    new_edge->next = src_vertex->edges;
-    src_vertex->edges = new_edge;
-    new_edge = (Edge*)malloc(sizeof(Edge));
-    new_edge->dest = strdup(src);
-    new_edge->dist = dist;
-    new_edge->next = dest_vertex->edges;
-    dest_vertex->edges = new_edge;
 }
 
 /**
- * @brief Reads a graph from a file.
+ * @brief Saves a graph as a binary file that readGraphFromFile maps.
  * @param g The graph.
  * @param filename The name of the file.
  */
+void writeGraph(Graph* g, const char* filename) {
+    writeGraphFile(g, g->numEdges, g->edgeStart, g->edges, GRAPH_MAGIC, filename);
+}
+
+/**
+ * @brief Reads a graph from a file: either a binary file written by
+ *        writeGraph, which is mapped, or text with one "src dest dist"
+ *        edge per line, which is parsed and finalized. Exits on a negative
+ *        distance.
+ * @param g An empty graph.
+ * @param filename The name of the file.
+ */
 void readGraphFromFile(Graph* g, const char* filename) {
     FILE* file = fopen(filename, "r");
     if (file == NULL) {
         fprintf(stderr, "Error: Could not open file %s\n", filename);
         exit(1);
     }
+    char magic[8];
+    if (fread(magic, 1, 8, file) == 8 && memcmp(magic, GRAPH_MAGIC, 8) == 0) {
+        fclose(file);
+        mapGraphFile(g, filename, GRAPH_MAGIC);
+        return;
+    }
+    rewind(file);
     char src[65], dest[65];
     int dist;
-    while (fscanf(file, "%s %s %d", src, dest, &dist) != EOF) {
-        addVertex(g, src);
-        addVertex(g, dest);
-        addEdge(g, src, dest, dist);
+    while (fscanf(file, "%64s %64s %d", src, dest, &dist) == 3) {
+        if (dist < 0) {
+            // Every search here assumes that a settled distance is final
+            fprintf(stderr, "Error: Negative distance %d between %s and %s\n", dist, src, dest);
+            exit(1);
+        }
+        int src_id = addVertex(g, src);
+        int dest_id = addVertex(g, dest);
+        addEdge(g, src_id, dest_id, dist);
     }
     fclose(file);
+    finalizeGraph(g);
 }
 
 /**
- * @brief Initializes the Dijkstra algorithm for a graph.
- * @param g The graph.
- * @param start The starting vertex.
+ * @brief Moves a heap entry up until its parent's key is no larger.
+ * @param s The search.
+ * @param i The heap position to start from.
  */
-void initDijkstra(Graph* g, const char* start) {
-    Vertex* cur = g->vertices;
-    while (cur != NULL) {
-        cur->minDist = (strcmp(cur->name, start) == 0) ? 0 : INT_MAX;
-        cur->visited = 0;  // Set to 0
-        cur = cur->next;
+static void siftUp(Search* s, int i) {
+    int id = s->heap[i];
+    int key = s->key[id];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (s->key[s->heap[parent]] <= key) {
+            break;
+        }
+        s->heap[i] = s->heap[parent];
+        s->heapIndex[s->heap[i]] = i;
+        i = parent;
     }
+    s->heap[i] = id;
+    s->heapIndex[id] = i;
 }
+
 /**
- * @brief Finds the vertex with the minimum distance in the graph.
- * @param g The graph.
- * @return A pointer to the vertex with the minimum distance.
+ * @brief Moves a heap entry down until no child has a smaller key.
+ * @param s The search.
+ * @param i The heap position to start from.
  */
-Vertex* findMinDistVertex(Graph* g) {
-    Vertex* min_vertex = NULL;
-    int min_dist = INT_MAX;
-    Vertex* cur = g->vertices;
-    while (cur != NULL) {
-        if (!cur->visited && cur->minDist < min_dist) {
-            min_dist = cur->minDist;
-            min_vertex = cur;
+static void siftDown(Search* s, int i) {
+    int id = s->heap[i];
+    int key = s->key[id];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s->heapSize) {
+            break;
+        }
+        if (child + 1 < s->heapSize && s->key[s->heap[child + 1]] < s->key[s->heap[child]]) {
+            child++;
+        }
+        if (s->key[s->heap[child]] >= key) {
+            break;
         }
-        cur = cur->next;
+        s->heap[i] = s->heap[child];
+        s->heapIndex[s->heap[i]] = i;
+        i = child;
+    }
+    s->heap[i] = id;
+    s->heapIndex[id] = i;
+}
+
+/**
+ * @brief Lowers a vertex's distance, queueing it if it is not queued yet.
+ * @param s The search.
+ * @param id The vertex.
+ * @param dist The new distance, smaller than the current one.
+ * @param key The new heap key, dist plus any lower bound on the rest of the way.
+ */
+static void decreaseKey(Search* s, int id, int dist, int key) {
+    if (s->dist[id] == INT_MAX) {
+        s->touched[s->numTouched++] = id;
+    }
+    s->dist[id] = dist;
+    s->key[id] = key;
+    if (s->heapIndex[id] == -1) {
+        s->heap[s->heapSize] = id;
+        s->heapIndex[id] = s->heapSize++;
+    }
+    siftUp(s, s->heapIndex[id]);
+}
+
+/**
+ * @brief Takes the vertex with the minimum key off the heap and settles it.
+ * @param s The search.
+ * @return The index of that vertex, -1 when the heap is empty.
+ */
+int popMinDistVertex(Search* s) {
+    if (s->heapSize == 0) {
+        return -1;
     }
-    if (min_vertex != NULL) {
-        min_vertex->visited = 1;  // Mark as visited
+    int min_vertex = s->heap[0];
+    s->heapIndex[min_vertex] = SETTLED;
+    if (--s->heapSize > 0) {
+        s->heap[0] = s->heap[s->heapSize];
+        siftDown(s, 0);
     }
     return min_vertex;
 }
 
 /**
- * @brief Implements Dijkstra's algorithm to find the shortest path between two vertices.
+ * @brief Starts a search from a source, allocating its arrays on first use
+ *        and otherwise resetting only the vertices the last search reached.
+ * @param s The search.
+ * @param n The number of vertices in the graph.
+ * @param source The source vertex.
+ * @param key The heap key of the source.
+ */
+static void startSearch(Search* s, int n, int source, int key) {
+    if (s->dist == NULL) {
+        s->dist = (int*)malloc(n * sizeof(int));
+        s->key = (int*)malloc(n * sizeof(int));
+        s->heapIndex = (int*)malloc(n * sizeof(int));
+        s->heap = (int*)malloc(n * sizeof(int));
+        s->touched = (int*)malloc(n * sizeof(int));
+        if (!s->dist || !s->key || !s->heapIndex || !s->heap || !s->touched) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        for (int id = 0; id < n; id++) {
+            s->dist[id] = INT_MAX;
+            s->heapIndex[id] = -1;
+        }
+    }
+    else {
+        for (int i = 0; i < s->numTouched; i++) {
+            s->dist[s->touched[i]] = INT_MAX;
+            s->heapIndex[s->touched[i]] = -1;
+        }
+    }
+    s->source = source;
+    s->numTouched = 0;
+    s->heapSize = 0;
+    decreaseKey(s, source, 0, key);
+}
+
+/**
+ * @brief Frees a search's arrays.
+ * @param s The search.
+ */
+static void freeSearch(Search* s) {
+    free(s->dist);
+    free(s->key);
+    free(s->heapIndex);
+    free(s->heap);
+    free(s->touched);
+}
+
+/**
+ * @brief Settles the closest vertex on the frontier and relaxes its edges.
  * @param g The graph.
+ * @param s The search.
+ * @return The vertex settled, -1 when the frontier is empty.
+ */
+static int settleNext(Graph* g, Search* s) {
+    int cur = popMinDistVertex(s);
+    if (cur == -1) {
+        return -1;
+    }
+    int cur_dist = s->dist[cur];
+    for (Edge* edge = &g->edges[g->edgeStart[cur]]; edge < &g->edges[g->edgeStart[cur + 1]]; edge++) {
+        int new_dist = cur_dist + edge->dist;
+        if (s->heapIndex[edge->dest] != SETTLED && new_dist < s->dist[edge->dest]) {
+            decreaseKey(s, edge->dest, new_dist, new_dist);
+        }
+    }
+    return cur;
+}
+
+/**
+ * @brief Creates a query engine with no cached searches.
+ * @param g The graph, which must not change while the engine is in use.
+ * @param mode QUERY_DIJKSTRA, QUERY_BIDIRECTIONAL, QUERY_ALT or QUERY_HIERARCHY;
+ *             the caller sets the hierarchy for the last.
+ * @return A pointer to the new engine.
+ */
+QueryEngine* initQueryEngine(Graph* g, int mode) {
+    QueryEngine* q = (QueryEngine*)calloc(1, sizeof(QueryEngine));
+    if (q == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    q->g = g;
+    q->mode = mode;
+    for (int i = 0; i < CACHED_SOURCES; i++) {
+        q->searches[i].source = -1;
+    }
+    return q;
+}
+
+/**
+ * @brief Picks landmarks farthest-first and stores every vertex's distance
+ *        to each of them. The first landmark is the vertex farthest from
+ *        vertex 0, each next one the vertex farthest from all landmarks so
+ *        far; a vertex no landmark reaches counts as farthest, so every
+ *        component gets a landmark while there are some left.
+ * @param q The query engine.
+ * @param count The number of landmarks.
+ */
+void chooseLandmarks(QueryEngine* q, int count) {
+    Graph* g = q->g;
+    int n = g->numVertices;
+    Search* s = &q->scratch[0];
+    q->numLandmarks = count < n ? count : n;
+    q->landmarkDist = (int*)malloc((size_t)n * q->numLandmarks * sizeof(int));
+    int* nearest = (int*)malloc(n * sizeof(int));
+    if (!q->landmarkDist || !nearest) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    int landmark = 0;
+    startSearch(s, n, 0, 0);
+    while (settleNext(g, s) != -1) {
+    }
+    for (int id = 0; id < n; id++) {
+        nearest[id] = INT_MAX;
+        if (s->dist[id] != INT_MAX && s->dist[id] > s->dist[landmark]) {
+            landmark = id;
+        }
+    }
+    for (int i = 0; i < q->numLandmarks; i++) {
+        startSearch(s, n, landmark, 0);
+        while (settleNext(g, s) != -1) {
+        }
+        int next = landmark;
+        for (int id = 0; id < n; id++) {
+            q->landmarkDist[(size_t)id * q->numLandmarks + i] = s->dist[id];
+            if (s->dist[id] < nearest[id]) {
+                nearest[id] = s->dist[id];
+            }
+            if (nearest[id] > nearest[next]) {
+                next = id;
+            }
+        }
+        landmark = next;
+    }
+    free(nearest);
+}
+
+/**
+ * @brief Lower bound on the distance between two vertices from the landmarks.
+ *        Landmarks that do not reach both vertices are skipped.
+ * @param q The query engine.
+ * @param id The vertex.
+ * @param end The end vertex.
+ * @return The largest |d(L, end) - d(L, id)| over the landmarks L.
+ */
+static int landmarkBound(QueryEngine* q, int id, int end) {
+    const int* from = &q->landmarkDist[(size_t)id * q->numLandmarks];
+    const int* to = &q->landmarkDist[(size_t)end * q->numLandmarks];
+    int bound = 0;
+    for (int i = 0; i < q->numLandmarks; i++) {
+        if (from[i] != INT_MAX && to[i] != INT_MAX) {
+            int difference = from[i] > to[i] ? from[i] - to[i] : to[i] - from[i];
+            if (difference > bound) {
+                bound = difference;
+            }
+        }
+    }
+    return bound;
+}
+
+/**
+ * @brief Returns the search from a source, starting a new one in the least
+ *        recently used entry if the source is not cached.
+ * @param q The query engine.
+ * @param start The source vertex.
+ * @return The search.
+ */
+Search* findSearch(QueryEngine* q, int start) {
+    Search* lru = &q->searches[0];
+    for (int i = 0; i < CACHED_SOURCES; i++) {
+        Search* s = &q->searches[i];
+        if (s->source == start) {
+            s->lastUsed = q->queries;
+            return s;
+        }
+        if (s->lastUsed < lru->lastUsed) {
+            lru = s;
+        }
+    }
+    startSearch(lru, q->g->numVertices, start, 0);
+    lru->lastUsed = q->queries;
+    return lru;
+}
+
+/**
+ * @brief Implements Dijkstra's algorithm to find the shortest path between two vertices.
+ *        The search stops as soon as the end is settled and is kept, so the next
+ *        query from the same start reads its answer or resumes where this one stopped.
+ * @param q The query engine.
+ * @param start The starting vertex.
+ * @param end The ending vertex.
+ * @return The shortest distance between the two vertices, -1 if there is no path.
+ */
+int dijkstra(QueryEngine* q, int start, int end) {
+    Search* s = findSearch(q, start);
+    while (s->heapIndex[end] != SETTLED) {
+        if (settleNext(q->g, s) == -1) {
+            return -1;  // The whole component is settled and end is not in it
+        }
+        q->settled++;
+    }
+    return s->dist[end];
+}
+
+/**
+ * @brief Searches from both ends at once, always advancing the side with
+ *        the smaller frontier. Every edge relaxed next to a vertex the other
+ *        side has reached gives a path; the search stops when the two
+ *        frontiers' closest distances add up to no less than the best one.
+ * @param q The query engine.
  * @param start The starting vertex.
  * @param end The ending vertex.
- * @return The shortest distance between the two vertices.
- */
-int dijkstra(Graph* g, const char* start, const char* end) {
-    initDijkstra(g, start);
-    Vertex* cur;
-    while ((cur = findMinDistVertex(g)) != NULL) {
-        Edge* edge = cur->edges;
-        while (edge != NULL) {
-            Vertex* dest_vertex = findVertex(g, edge->dest);
-            if (dest_vertex->minDist != -1) {
-                int new_dist = cur->minDist + edge->dist;
-                if (new_dist < dest_vertex->minDist) {
-                    dest_vertex->minDist = new_dist;
+ * @return The shortest distance between the two vertices, -1 if there is no path.
+ */
+int bidirectionalDijkstra(QueryEngine* q, int start, int end) {
+    Graph* g = q->g;
+    Search* forward = &q->scratch[0];
+    Search* backward = &q->scratch[1];
+    startSearch(forward, g->numVertices, start, 0);
+    startSearch(backward, g->numVertices, end, 0);
+    long best = start == end ? 0 : LONG_MAX;
+
+    while (forward->heapSize > 0 && backward->heapSize > 0) {
+        if ((long)forward->dist[forward->heap[0]] + backward->dist[backward->heap[0]] >= best) {
+            break;
+        }
+        Search* s = forward->heapSize <= backward->heapSize ? forward : backward;
+        Search* other = s == forward ? backward : forward;
+        int cur = popMinDistVertex(s);
+        int cur_dist = s->dist[cur];
+        q->settled++;
+        for (Edge* edge = &g->edges[g->edgeStart[cur]]; edge < &g->edges[g->edgeStart[cur + 1]]; edge++) {
+            int new_dist = cur_dist + edge->dist;
+            if (s->heapIndex[edge->dest] != SETTLED && new_dist < s->dist[edge->dest]) {
+                decreaseKey(s, edge->dest, new_dist, new_dist);
+            }
+            if (other->dist[edge->dest] != INT_MAX && (long)new_dist + other->dist[edge->dest] < best) {
+                best = (long)new_dist + other->dist[edge->dest];
+            }
+        }
+    }
+    return best == LONG_MAX ? -1 : (int)best;
+}
+
+/**
+ * @brief A* from start to end, ordered by distance plus the landmark lower
+ *        bound to the end. The bound is consistent, so a settled vertex
+ *        never has to be reopened and the end is final once popped.
+ * @param q The query engine, with landmarks chosen.
+ * @param start The starting vertex.
+ * @param end The ending vertex.
+ * @return The shortest distance between the two vertices, -1 if there is no path.
+ */
+int altSearch(QueryEngine* q, int start, int end) {
+    Graph* g = q->g;
+    Search* s = &q->scratch[0];
+    startSearch(s, g->numVertices, start, landmarkBound(q, start, end));
+    while (s->heapIndex[end] != SETTLED) {
+        int cur = popMinDistVertex(s);
+        if (cur == -1) {
+            return -1;
+        }
+        int cur_dist = s->dist[cur];
+        q->settled++;
+        for (Edge* edge = &g->edges[g->edgeStart[cur]]; edge < &g->edges[g->edgeStart[cur + 1]]; edge++) {
+            int new_dist = cur_dist + edge->dist;
+            if (s->heapIndex[edge->dest] != SETTLED && new_dist < s->dist[edge->dest]) {
+                decreaseKey(s, edge->dest, new_dist, new_dist + landmarkBound(q, edge->dest, end));
+            }
+        }
+    }
+    return s->dist[end];
+}
+
+// Edges of a vertex that is not contracted yet, while a hierarchy is built
+typedef struct Adjacency {
+    int* to;
+    int* weight;
+    int count;
+    int capacity;
+} Adjacency;
+
+/**
+ * @brief Adds an edge to an adjacency list, or shortens the one already there.
+ * @param a The adjacency list.
+ * @param to The destination vertex.
+ * @param weight The length of the edge.
+ * @return 1 if the edge was added, 0 if it was there already.
+ */
+static int addArc(Adjacency* a, int to, int weight) {
+    for (int i = 0; i < a->count; i++) {
+        if (a->to[i] == to) {
+            if (weight < a->weight[i]) {
+                a->weight[i] = weight;
+            }
+            return 0;
+        }
+    }
+    if (a->count == a->capacity) {
+        a->capacity = a->capacity ? a->capacity * 2 : 4;
+        a->to = (int*)realloc(a->to, a->capacity * sizeof(int));
+        a->weight = (int*)realloc(a->weight, a->capacity * sizeof(int));
+        if (!a->to || !a->weight) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    a->to[a->count] = to;
+    a->weight[a->count++] = weight;
+    return 1;
+}
+
+/**
+ * @brief Removes the edge to a vertex from an adjacency list.
+ * @param a The adjacency list.
+ * @param to The destination vertex.
+ */
+static void removeArc(Adjacency* a, int to) {
+    for (int i = 0; i < a->count; i++) {
+        if (a->to[i] == to) {
+            a->count--;
+            a->to[i] = a->to[a->count];
+            a->weight[i] = a->weight[a->count];
+            return;
+        }
+    }
+}
+
+// A contraction hierarchy being built
+typedef struct Contraction {
+    Adjacency* adj;      // Edges of the vertices not contracted yet
+    int n;
+    Search witness;
+    Search order;        // Vertices not contracted yet, keyed by priority
+    int* deleted;        // Neighbours contracted so far
+    int* level;          // Length of the longest chain of contracted vertices below
+    int* neighbourOf;    // Vertex being contracted that a vertex was last seen next to
+    int* neighbourIndex; // Its position in that vertex's adjacency list
+    int* shortcuts;      // Found by the last findShortcuts, as (from, to, weight) triples
+    int numShortcuts;
+    int shortcutCapacity;
+} Contraction;
+
+/**
+ * @brief Looks for paths between neighbours of the vertex being contracted
+ *        that avoid it, from its i-th neighbour to the ones after it. Stops
+ *        once all of those are settled, past a distance limit, or after
+ *        WITNESS_SETTLE_LIMIT vertices; a distance left too long only costs
+ *        a shortcut that was not needed.
+ * @param c The contraction, with the neighbours of v marked.
+ * @param v The vertex being contracted.
+ * @param i The neighbour to search from.
+ * @param limit The longest path through v that needs a witness.
+ */
+static void witnessSearch(Contraction* c, int v, int i, int limit) {
+    Search* s = &c->witness;
+    int targets = c->adj[v].count - i - 1;
+    startSearch(s, c->n, c->adj[v].to[i], 0);
+    for (int settled = 0; settled < WITNESS_SETTLE_LIMIT && targets > 0; settled++) {
+        int cur = popMinDistVertex(s);
+        if (cur == -1) {
+            break;
+        }
+        if (c->neighbourOf[cur] == v && c->neighbourIndex[cur] > i) {
+            targets--;
+        }
+        Adjacency* a = &c->adj[cur];
+        for (int k = 0; k < a->count; k++) {
+            int new_dist = s->dist[cur] + a->weight[k];
+            if (new_dist <= limit && a->to[k] != v && s->heapIndex[a->to[k]] != SETTLED &&
+                new_dist < s->dist[a->to[k]]) {
+                decreaseKey(s, a->to[k], new_dist, new_dist);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Finds the shortcuts contracting a vertex needs: one for every pair
+ *        of its neighbours whose shortest path goes through it.
+ * @param c The contraction.
+ * @param v The vertex.
+ */
+static void findShortcuts(Contraction* c, int v) {
+    Adjacency* a = &c->adj[v];
+    c->numShortcuts = 0;
+    for (int i = 0; i < a->count; i++) {
+        c->neighbourOf[a->to[i]] = v;
+        c->neighbourIndex[a->to[i]] = i;
+    }
+    for (int i = 0; i + 1 < a->count; i++) {
+        int limit = 0;
+        for (int j = i + 1; j < a->count; j++) {
+            if (a->weight[i] + a->weight[j] > limit) {
+                limit = a->weight[i] + a->weight[j];
+            }
+        }
+        witnessSearch(c, v, i, limit);
+        for (int j = i + 1; j < a->count; j++) {
+            int via = a->weight[i] + a->weight[j];
+            if (c->witness.dist[a->to[j]] <= via) {
+                continue;
+            }
+            if (c->numShortcuts == c->shortcutCapacity) {
+                c->shortcutCapacity = c->shortcutCapacity ? c->shortcutCapacity * 2 : 64;
+                c->shortcuts = (int*)realloc(c->shortcuts, c->shortcutCapacity * 3 * sizeof(int));
+                if (c->shortcuts == NULL) {
+                    fprintf(stderr, "Error: Out of memory\n");
+                    exit(1);
                 }
             }
-            edge = edge->next;
+            int* shortcut = &c->shortcuts[c->numShortcuts++ * 3];
+            shortcut[0] = a->to[i];
+            shortcut[1] = a->to[j];
+            shortcut[2] = via;
+        }
+    }
+}
+
+/**
+ * @brief The cost of contracting a vertex now, lower is sooner: the edge
+ *        difference (shortcuts added minus edges removed) counted twice,
+ *        plus the neighbours contracted before it and its level, which
+ *        spread the contractions over the graph and keep the hierarchy flat.
+ *        Leaves the shortcuts in c->shortcuts.
+ * @param c The contraction.
+ * @param v The vertex.
+ * @return The priority.
+ */
+static int contractionPriority(Contraction* c, int v) {
+    findShortcuts(c, v);
+    return 2 * (c->numShortcuts - c->adj[v].count) + c->deleted[v] + c->level[v];
+}
+
+/**
+ * @brief Builds a contraction hierarchy. Vertices are contracted cheapest
+ *        first, with priorities updated lazily: the cheapest one is
+ *        re-evaluated when it comes up and put back if it no longer is.
+ *        Re-evaluating every neighbour after each contraction as well gave
+ *        a few percent fewer shortcuts for six times the preprocessing.
+ *        A contracted vertex keeps the edges it had left, which are exactly
+ *        its upward edges.
+ *        On graphs that are not road-like, the uncontracted vertices
+ *        quickly become densely connected and each contraction costs more
+ *        than the last, so contraction stops once their average degree
+ *        passes CORE_DEGREE_LIMIT, unless fewer than one in CORE_MIN_SHARE
+ *        vertices is left. The vertices left form the core at the top of
+ *        the hierarchy; they keep all their edges, in both directions, and
+ *        a query searches the core like plain bidirectional Dijkstra.
+ * @param g The graph.
+ * @return The hierarchy, with the graph's vertex ids.
+ */
+Hierarchy* buildHierarchy(Graph* g) {
+    int n = g->numVertices;
+    Hierarchy* h = (Hierarchy*)calloc(1, sizeof(Hierarchy));
+    Contraction c = { 0 };
+    c.n = n;
+    c.adj = (Adjacency*)calloc(n > 0 ? n : 1, sizeof(Adjacency));
+    c.deleted = (int*)calloc(n > 0 ? n : 1, sizeof(int));
+    c.level = (int*)calloc(n > 0 ? n : 1, sizeof(int));
+    c.neighbourOf = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    c.neighbourIndex = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    if (!h || !c.adj || !c.deleted || !c.level || !c.neighbourOf || !c.neighbourIndex) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int id = 0; id < n; id++) {
+        c.neighbourOf[id] = -1;
+        for (Edge* edge = &g->edges[g->edgeStart[id]]; edge < &g->edges[g->edgeStart[id + 1]]; edge++) {
+            if (edge->dest != id) {
+                addArc(&c.adj[id], edge->dest, edge->dist);  // Keeps the shortest of parallel edges
+            }
+        }
+    }
+
+    // The order is a Search heap whose keys are priorities rather than distances
+    for (int id = 0; id < n; id++) {
+        if (id == 0) {
+            startSearch(&c.order, n, 0, contractionPriority(&c, 0));
+        }
+        else {
+            decreaseKey(&c.order, id, 0, contractionPriority(&c, id));
+        }
+    }
+    long arcs = 0;  // Edges between uncontracted vertices, counted from both ends
+    for (int id = 0; id < n; id++) {
+        arcs += c.adj[id].count;
+    }
+    int remaining = n;
+    int v;
+    while (n > 0 && (v = popMinDistVertex(&c.order)) != -1) {
+        if (arcs > (long)remaining * CORE_DEGREE_LIMIT && remaining > n / CORE_MIN_SHARE) {
+            break;  // A dense core: every contraction would cost more than the one before
+        }
+        int priority = contractionPriority(&c, v);
+        if (c.order.heapSize > 0 && priority > c.order.key[c.order.heap[0]]) {
+            c.order.heapIndex[v] = -1;
+            decreaseKey(&c.order, v, 0, priority);
+            continue;
+        }
+        for (int i = 0; i < c.numShortcuts; i++) {
+            int* shortcut = &c.shortcuts[i * 3];
+            arcs += addArc(&c.adj[shortcut[0]], shortcut[1], shortcut[2]);
+            arcs += addArc(&c.adj[shortcut[1]], shortcut[0], shortcut[2]);
+        }
+        h->numShortcuts += c.numShortcuts;
+        Adjacency* a = &c.adj[v];
+        arcs -= 2 * a->count;
+        remaining--;
+        for (int i = 0; i < a->count; i++) {
+            removeArc(&c.adj[a->to[i]], v);
+            c.deleted[a->to[i]]++;
+            if (c.level[a->to[i]] < c.level[v] + 1) {
+                c.level[a->to[i]] = c.level[v] + 1;
+            }
+        }
+    }
+    h->coreVertices = n > 0 ? remaining : 0;
+    freeSearch(&c.witness);
+    freeSearch(&c.order);
+    free(c.shortcuts);
+    free(c.deleted);
+    free(c.level);
+    free(c.neighbourOf);
+    free(c.neighbourIndex);
+    Adjacency* adj = c.adj;
+
+    Graph* up = initGraph();
+    up->numVertices = n;
+    up->edgeStart = (int*)malloc((n + 1) * sizeof(int));
+    if (up->edgeStart == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    up->edgeStart[0] = 0;
+    for (int id = 0; id < n; id++) {
+        up->edgeStart[id + 1] = up->edgeStart[id] + adj[id].count;
+    }
+    up->numEdges = up->edgeStart[n];
+    up->edges = (Edge*)malloc((up->numEdges > 0 ? up->numEdges : 1) * sizeof(Edge));
+    if (up->edges == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int id = 0; id < n; id++) {
+        Edge* edge = &up->edges[up->edgeStart[id]];
+        for (int i = 0; i < adj[id].count; i++) {
+            edge[i].dest = adj[id].to[i];
+            edge[i].dist = adj[id].weight[i];
+        }
+        free(adj[id].to);
+        free(adj[id].weight);
+    }
+    h->up = up;
+    free(adj);
+    return h;
+}
+
+/**
+ * @brief Saves a hierarchy in the binary graph format, with its upward edges
+ *        and the names of the graph it was built from.
+ * @param h The hierarchy.
+ * @param g The graph it was built from.
+ * @param filename The name of the file.
+ */
+void writeHierarchy(Hierarchy* h, Graph* g, const char* filename) {
+    writeGraphFile(g, h->up->numEdges, h->up->edgeStart, h->up->edges, HIERARCHY_MAGIC, filename);
+}
+
+/**
+ * @brief Maps a hierarchy saved by writeHierarchy.
+ * @param filename The name of the file.
+ * @return The hierarchy, whose upward graph also holds the vertex names.
+ */
+Hierarchy* readHierarchy(const char* filename) {
+    Hierarchy* h = (Hierarchy*)calloc(1, sizeof(Hierarchy));
+    if (h == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    h->up = initGraph();
+    mapGraphFile(h->up, filename, HIERARCHY_MAGIC);
+    return h;
+}
+
+/**
+ * @brief Frees a hierarchy and its upward graph.
+ * @param h The hierarchy.
+ */
+void freeHierarchy(Hierarchy* h) {
+    freeGraph(h->up);
+    free(h);
+}
+
+/**
+ * @brief Stall-on-demand: a vertex that a higher neighbour already reached
+ *        reaches for less was reached along a path that is not shortest,
+ *        so relaxing its edges cannot lead anywhere useful. The edges to
+ *        the higher neighbours are the vertex's own upward edges, since
+ *        every edge is stored both ways.
+ * @param h The hierarchy.
+ * @param s The search that just settled the vertex.
+ * @param id The vertex.
+ * @return 1 if the vertex's edges need not be relaxed.
+ */
+static int isStalled(Hierarchy* h, Search* s, int id) {
+    Graph* up = h->up;
+    for (Edge* edge = &up->edges[up->edgeStart[id]]; edge < &up->edges[up->edgeStart[id + 1]]; edge++) {
+        int above = s->dist[edge->dest];
+        if (above != INT_MAX && above + edge->dist < s->dist[id]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Answers a query with two upward searches over the hierarchy, one
+ *        from each end, always advancing the one whose closest vertex is
+ *        nearer. A vertex settled by one side and reached by the other
+ *        gives a path; each side stops once its frontier is no closer than
+ *        the best path, since the upward searches cannot stop where they meet.
+ * @param q The query engine, with a hierarchy.
+ * @param start The starting vertex.
+ * @param end The ending vertex.
+ * @return The shortest distance between the two vertices, -1 if there is no path.
+ */
+int hierarchySearch(QueryEngine* q, int start, int end) {
+    Hierarchy* h = q->hierarchy;
+    Graph* up = h->up;
+    Search* forward = &q->scratch[0];
+    Search* backward = &q->scratch[1];
+    startSearch(forward, up->numVertices, start, 0);
+    startSearch(backward, up->numVertices, end, 0);
+    long best = LONG_MAX;
+
+    for (;;) {
+        int forward_open = forward->heapSize > 0 && forward->dist[forward->heap[0]] < best;
+        int backward_open = backward->heapSize > 0 && backward->dist[backward->heap[0]] < best;
+        if (!forward_open && !backward_open) {
+            break;
+        }
+        Search* s = forward;
+        if (!forward_open || (backward_open && backward->dist[backward->heap[0]] < forward->dist[forward->heap[0]])) {
+            s = backward;
+        }
+        Search* other = s == forward ? backward : forward;
+        int cur = popMinDistVertex(s);
+        int cur_dist = s->dist[cur];
+        q->settled++;
+        if (other->dist[cur] != INT_MAX && (long)cur_dist + other->dist[cur] < best) {
+            best = (long)cur_dist + other->dist[cur];
+        }
+        if (isStalled(h, s, cur)) {
+            continue;
+        }
+        for (Edge* edge = &up->edges[up->edgeStart[cur]]; edge < &up->edges[up->edgeStart[cur + 1]]; edge++) {
+            int new_dist = cur_dist + edge->dist;
+            if (s->heapIndex[edge->dest] != SETTLED && new_dist < s->dist[edge->dest]) {
+                decreaseKey(s, edge->dest, new_dist, new_dist);
+            }
         }
     }
-    Vertex* end_vertex = findVertex(g, end);
-    if (end_vertex == NULL || end_vertex->minDist == INT_MAX) {
+    return best == LONG_MAX ? -1 : (int)best;
+}
+
+/**
+ * @brief Answers one query in the engine's mode.
+ * @param q The query engine.
+ * @param start The name of the starting vertex.
+ * @param end The name of the ending vertex.
+ * @return The shortest distance between the two vertices, -1 if there is no path
+ *         or either vertex does not exist.
+ */
+int shortestDistance(QueryEngine* q, const char* start, const char* end) {
+    int start_id = findVertex(q->g, start);
+    int end_id = findVertex(q->g, end);
+    if (start_id == -1 || end_id == -1) {
         return -1;
     }
-    return end_vertex->minDist;
+    q->queries++;
+    if (q->mode == QUERY_BIDIRECTIONAL) {
+        return bidirectionalDijkstra(q, start_id, end_id);
+    }
+    if (q->mode == QUERY_ALT) {
+        return altSearch(q, start_id, end_id);
+    }
+    if (q->mode == QUERY_HIERARCHY) {
+        return hierarchySearch(q, start_id, end_id);
+    }
+    return dijkstra(q, start_id, end_id);
+}
+
+/**
+ * @brief Frees a query engine, its cached searches and its landmarks,
+ *        unless it shares them.
+ * @param q The query engine.
+ */
+void freeQueryEngine(QueryEngine* q) {
+    for (int i = 0; i < CACHED_SOURCES; i++) {
+        freeSearch(&q->searches[i]);
+    }
+    freeSearch(&q->scratch[0]);
+    freeSearch(&q->scratch[1]);
+    if (!q->sharesLandmarks) {
+        free(q->landmarkDist);
+    }
+    free(q);
+}
+
+/**
+ * @brief Creates an engine for another thread: its own searches over the
+ *        same graph, hierarchy and landmarks.
+ * @param q The engine to share.
+ * @return The new engine, freed with freeQueryEngine before q is.
+ */
+QueryEngine* shareQueryEngine(QueryEngine* q) {
+    QueryEngine* copy = initQueryEngine(q->g, q->mode);
+    copy->hierarchy = q->hierarchy;
+    copy->landmarkDist = q->landmarkDist;
+    copy->numLandmarks = q->numLandmarks;
+    copy->sharesLandmarks = 1;
+    return copy;
+}
+
+/**
+ * @brief Answers queries of the current batch, QUERY_CHUNK at a time, until
+ *        none are left. Neighbouring queries often share a source, so
+ *        taking them together keeps the engine's source cache useful.
+ * @param p The pool.
+ * @param q The engine of the calling thread.
+ */
+static void answerChunks(QueryPool* p, QueryEngine* q) {
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        int first = p->next;
+        p->next += QUERY_CHUNK;
+        pthread_mutex_unlock(&p->lock);
+        if (first >= p->count) {
+            return;
+        }
+        int last = first + QUERY_CHUNK < p->count ? first + QUERY_CHUNK : p->count;
+        for (int i = first; i < last; i++) {
+            p->answers[i] = shortestDistance(q, p->starts[i], p->ends[i]);
+        }
+    }
+}
+
+// A worker thread's pool and the index of its engine
+typedef struct QueryWorker {
+    QueryPool* pool;
+    int index;
+} QueryWorker;
+
+/**
+ * @brief Worker thread: waits for a batch, helps answer it, reports done.
+ * @param arg The QueryWorker, freed by the thread.
+ * @return NULL.
+ */
+static void* queryWorker(void* arg) {
+    QueryWorker* worker = (QueryWorker*)arg;
+    QueryPool* p = worker->pool;
+    QueryEngine* q = p->engines[worker->index];
+    free(worker);
+    long seen = 0;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->batch == seen && !p->closing) {
+            pthread_cond_wait(&p->wake, &p->lock);
+        }
+        if (p->closing) {
+            break;
+        }
+        seen = p->batch;
+        pthread_mutex_unlock(&p->lock);
+        answerChunks(p, q);
+        pthread_mutex_lock(&p->lock);
+        if (--p->busy == 0) {
+            pthread_cond_signal(&p->idle);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/**
+ * @brief Starts threads - 1 workers; the caller is the last thread.
+ * @param q The caller's engine, shared with the workers.
+ * @param threads The number of threads answering queries.
+ * @return The pool.
+ */
+QueryPool* initQueryPool(QueryEngine* q, int threads) {
+    QueryPool* p = (QueryPool*)calloc(1, sizeof(QueryPool));
+    if (p == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    p->numThreads = threads;
+    p->engines = (QueryEngine**)malloc(threads * sizeof(QueryEngine*));
+    p->threads = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    p->starts = (char (*)[65])malloc(QUERY_BATCH * sizeof(*p->starts));
+    p->ends = (char (*)[65])malloc(QUERY_BATCH * sizeof(*p->ends));
+    p->answers = (int*)malloc(QUERY_BATCH * sizeof(int));
+    if (!p->engines || !p->threads || !p->starts || !p->ends || !p->answers) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->idle, NULL);
+    p->engines[0] = q;
+    for (int i = 1; i < threads; i++) {
+        p->engines[i] = shareQueryEngine(q);
+        QueryWorker* worker = (QueryWorker*)malloc(sizeof(QueryWorker));
+        worker->pool = p;
+        worker->index = i;
+        if (pthread_create(&p->threads[i], NULL, queryWorker, worker) != 0) {
+            fprintf(stderr, "Error: Could not start a query thread\n");
+            exit(1);
+        }
+    }
+    return p;
+}
+
+/**
+ * @brief Answers the first count queries in starts and ends into answers,
+ *        on every thread of the pool.
+ * @param p The pool.
+ * @param count The number of queries, at most QUERY_BATCH.
+ */
+void answerBatch(QueryPool* p, int count) {
+    pthread_mutex_lock(&p->lock);
+    p->count = count;
+    p->next = 0;
+    p->busy = p->numThreads - 1;
+    p->batch++;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    answerChunks(p, p->engines[0]);
+    pthread_mutex_lock(&p->lock);
+    while (p->busy > 0) {
+        pthread_cond_wait(&p->idle, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * @brief Stops the workers and frees their engines, adding their query and
+ *        settled counts to the caller's engine.
+ * @param p The pool.
+ */
+void freeQueryPool(QueryPool* p) {
+    pthread_mutex_lock(&p->lock);
+    p->closing = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 1; i < p->numThreads; i++) {
+        pthread_join(p->threads[i], NULL);
+        p->engines[0]->queries += p->engines[i]->queries;
+        p->engines[0]->settled += p->engines[i]->settled;
+        freeQueryEngine(p->engines[i]);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    pthread_cond_destroy(&p->idle);
+    free(p->engines);
+    free(p->threads);
+    free(p->starts);
+    free(p->ends);
+    free(p->answers);
+    free(p);
+}
+
+/**
+ * @brief Computes the distance from a source to every vertex with plain
+ *        Dijkstra, on one thread.
+ * @param g The graph.
+ * @param source The source vertex.
+ * @param dist Receives g->numVertices distances, INT_MAX where unreachable.
+ */
+void dijkstraAll(Graph* g, int source, int* dist) {
+    Search s = { 0 };
+    startSearch(&s, g->numVertices, source, 0);
+    while (settleNext(g, &s) != -1) {
+    }
+    memcpy(dist, s.dist, g->numVertices * sizeof(int));
+    freeSearch(&s);
+}
+
+/**
+ * @brief A bucket width that suits most graphs: the mean edge length, so a
+ *        vertex has about one light edge per unit of degree.
+ * @param g The graph.
+ * @return The width, at least 1.
+ */
+int defaultDelta(Graph* g) {
+    long long total = 0;
+    for (int e = 0; e < g->numEdges; e++) {
+        total += g->edges[e].dist;
+    }
+    long long delta = g->numEdges > 0 ? total / g->numEdges : 1;
+    return delta < 1 ? 1 : delta > INT_MAX / 2 ? INT_MAX / 2 : (int)delta;
+}
+
+// Vertices one delta-stepping thread has put in a bucket or frontier
+typedef struct VertexList {
+    int* items;
+    int size;
+    int capacity;
+} VertexList;
+
+/**
+ * @brief Appends a vertex to a list.
+ * @param list The list.
+ * @param id The vertex.
+ */
+static void pushVertex(VertexList* list, int id) {
+    if (list->size == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->items = (int*)realloc(list->items, list->capacity * sizeof(int));
+        if (list->items == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    list->items[list->size++] = id;
+}
+
+struct DeltaRun;
+
+// One thread of a delta-stepping run. Each thread keeps the buckets it
+// filled itself, so inserting never takes a lock; a bucket is the union of
+// the threads' lists, stale entries included, and is filtered when its
+// turn comes. Only the numBuckets buckets from the current one on are
+// kept, in a ring; vertices further ahead wait in the far list until the
+// current bucket gets close enough.
+typedef struct DeltaWorker {
+    struct DeltaRun* run;
+    int index;
+    VertexList* buckets;  // Vertices this thread put in bucket b, at [b % numBuckets]
+    VertexList far;       // Vertices put in a bucket numBuckets or more ahead of the current one
+    int farLowest;        // Lowest bucket in far, INT_MAX if it is empty
+    VertexList frontier;  // This thread's share of the current light phase
+    VertexList next;      // Lowered into the current bucket, for the next light phase
+    VertexList removed;   // Taken out of the current bucket, for the heavy edges
+    int lowest;           // First nonempty bucket from the current one on, INT_MAX if none
+} DeltaWorker;
+
+// State shared by the threads of a delta-stepping run
+typedef struct DeltaRun {
+    Graph* g;
+    int* dist;
+    int delta;
+    int numBuckets;       // Buckets in each thread's ring: maxEdge / delta + 2, at most DELTA_BUCKETS
+    int numThreads;
+    DeltaWorker* workers;
+    pthread_barrier_t barrier;
+    int current;          // Bucket being emptied, INT_MAX once all are empty
+    int stamp;            // Frontier being built, for queuedIn
+    int* queuedIn;        // Stamp of the last frontier a vertex joined
+    int* removedFrom;     // Last bucket a vertex was taken out of, plus one
+    int* frontierStart;   // Where each thread's frontier starts in the phase's, numThreads + 1
+    int nextChunk;        // First frontier position no thread has taken yet
+    int phases;           // Light phases run
+} DeltaRun;
+
+/**
+ * @brief Lowers a distance that other threads may be lowering too.
+ * @param dist The distances.
+ * @param id The vertex.
+ * @param new_dist The candidate distance.
+ * @return 1 if the distance was lowered.
+ */
+static int lowerDistance(int* dist, int id, int new_dist) {
+    int old = __atomic_load_n(&dist[id], __ATOMIC_RELAXED);
+    while (new_dist < old) {
+        if (__atomic_compare_exchange_n(&dist[id], &old, new_dist, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Puts a vertex in one of this thread's buckets, or in its far list
+ *        if the bucket is past the end of the ring.
+ * @param w The thread.
+ * @param bucket The bucket, not before the current one.
+ * @param id The vertex.
+ */
+static void addToBucket(DeltaWorker* w, int bucket, int id) {
+    DeltaRun* r = w->run;
+    if (bucket - r->current < r->numBuckets) {
+        pushVertex(&w->buckets[bucket % r->numBuckets], id);
+        return;
+    }
+    pushVertex(&w->far, id);
+    if (bucket < w->farLowest) {
+        w->farLowest = bucket;
+    }
+}
+
+/**
+ * @brief Moves the vertices of the far list whose buckets are now in the
+ *        ring into it. Vertices settled since are dropped, and farLowest
+ *        is recomputed from the rest.
+ * @param w The thread.
+ */
+static void pullFar(DeltaWorker* w) {
+    DeltaRun* r = w->run;
+    int kept = 0;
+    w->farLowest = INT_MAX;
+    for (int i = 0; i < w->far.size; i++) {
+        int id = w->far.items[i];
+        int bucket = r->dist[id] / r->delta;
+        if (bucket < r->current) {
+            continue;
+        }
+        if (bucket - r->current < r->numBuckets) {
+            pushVertex(&w->buckets[bucket % r->numBuckets], id);
+            continue;
+        }
+        w->far.items[kept++] = id;
+        if (bucket < w->farLowest) {
+            w->farLowest = bucket;
+        }
+    }
+    w->far.size = kept;
+}
+
+/**
+ * @brief Relaxes the edges of a vertex on one side of delta.
+ * @param w The thread.
+ * @param id The vertex, whose distance is known.
+ * @param heavy 0 for the edges no longer than delta, 1 for the others.
+ */
+static void relaxEdges(DeltaWorker* w, int id, int heavy) {
+    DeltaRun* r = w->run;
+    Graph* g = r->g;
+    int cur_dist = __atomic_load_n(&r->dist[id], __ATOMIC_RELAXED);
+    for (Edge* edge = &g->edges[g->edgeStart[id]]; edge < &g->edges[g->edgeStart[id + 1]]; edge++) {
+        if ((edge->dist > r->delta) != heavy) {
+            continue;
+        }
+        int new_dist = cur_dist + edge->dist;
+        if (!lowerDistance(r->dist, edge->dest, new_dist)) {
+            continue;
+        }
+        int bucket = new_dist / r->delta;
+        if (bucket != r->current) {
+            addToBucket(w, bucket, edge->dest);
+        }
+        else if (__atomic_exchange_n(&r->queuedIn[edge->dest], r->stamp, __ATOMIC_RELAXED) != r->stamp) {
+            pushVertex(&w->next, edge->dest);
+        }
+    }
+}
+
+/**
+ * @brief One light phase for one thread: takes chunks of the frontier,
+ *        whichever thread's share they are in, and relaxes their light
+ *        edges. Vertices lowered into the current bucket go to w->next.
+ * @param w The thread.
+ */
+static void relaxFrontier(DeltaWorker* w) {
+    DeltaRun* r = w->run;
+    int total = r->frontierStart[r->numThreads];
+    for (;;) {
+        int first = __atomic_fetch_add(&r->nextChunk, DELTA_CHUNK, __ATOMIC_RELAXED);
+        if (first >= total) {
+            return;
+        }
+        int last = first + DELTA_CHUNK < total ? first + DELTA_CHUNK : total;
+        int owner = 0;
+        for (int i = first; i < last; i++) {
+            while (i >= r->frontierStart[owner + 1]) {
+                owner++;
+            }
+            int id = r->workers[owner].frontier.items[i - r->frontierStart[owner]];
+            if (__atomic_exchange_n(&r->removedFrom[id], r->current + 1, __ATOMIC_RELAXED) != r->current + 1) {
+                pushVertex(&w->removed, id);
+            }
+            relaxEdges(w, id, 0);
+        }
+    }
+}
+
+/**
+ * @brief The loop every thread of a run executes, in lockstep between
+ *        barriers: pick the lowest nonempty bucket over all threads, empty
+ *        it with light phases until no light edge lowers a distance inside
+ *        it, then relax the heavy edges of everything taken out of it.
+ *        When the rings are empty the current bucket jumps straight to the
+ *        lowest one in the far lists, however far ahead it is.
+ * @param arg The DeltaWorker.
+ * @return NULL.
+ */
+static void* deltaWorker(void* arg) {
+    DeltaWorker* w = (DeltaWorker*)arg;
+    DeltaRun* r = w->run;
+    for (;;) {
+        // The scan stops at the far list's lowest bucket, so it can't pass INT_MAX
+        w->lowest = w->farLowest;
+        for (int offset = 0; offset < r->numBuckets && offset < w->lowest - r->current; offset++) {
+            if (w->buckets[(r->current + offset) % r->numBuckets].size > 0) {
+                w->lowest = r->current + offset;
+                break;
+            }
+        }
+        pthread_barrier_wait(&r->barrier);
+        if (w->index == 0) {
+            r->current = INT_MAX;
+            for (int t = 0; t < r->numThreads; t++) {
+                if (r->workers[t].lowest < r->current) {
+                    r->current = r->workers[t].lowest;
+                }
+            }
+            r->stamp++;
+        }
+        pthread_barrier_wait(&r->barrier);
+        if (r->current == INT_MAX) {
+            return NULL;
+        }
+
+        // Entries that were lowered into an earlier bucket since are stale
+        int bucket = r->current;
+        w->frontier.size = 0;
+        w->removed.size = 0;
+        if (w->farLowest - bucket < r->numBuckets) {
+            pullFar(w);
+        }
+        VertexList* list = &w->buckets[bucket % r->numBuckets];
+        for (int i = 0; i < list->size; i++) {
+            int id = list->items[i];
+            if (r->dist[id] / r->delta == bucket &&
+                __atomic_exchange_n(&r->queuedIn[id], r->stamp, __ATOMIC_RELAXED) != r->stamp) {
+                pushVertex(&w->frontier, id);
+            }
+        }
+        list->size = 0;
+        for (;;) {
+            pthread_barrier_wait(&r->barrier);
+            if (w->index == 0) {
+                r->frontierStart[0] = 0;
+                for (int t = 0; t < r->numThreads; t++) {
+                    r->frontierStart[t + 1] = r->frontierStart[t] + r->workers[t].frontier.size;
+                }
+                r->nextChunk = 0;
+                r->stamp++;
+                r->phases++;
+            }
+            pthread_barrier_wait(&r->barrier);
+            if (r->frontierStart[r->numThreads] == 0) {
+                break;
+            }
+            w->next.size = 0;
+            relaxFrontier(w);
+            pthread_barrier_wait(&r->barrier);
+            VertexList swap = w->frontier;
+            w->frontier = w->next;
+            w->next = swap;
+        }
+        for (int i = 0; i < w->removed.size; i++) {
+            relaxEdges(w, w->removed.items[i], 1);  // Always into a later bucket
+        }
+    }
+}
+
+/**
+ * @brief Delta-stepping single-source shortest paths (Meyer and Sanders).
+ *        Vertices are kept in buckets of width delta by tentative distance.
+ *        The lowest nonempty bucket is emptied in phases that relax the
+ *        light edges (no longer than delta) of its whole frontier at once,
+ *        split between the threads, since those can put vertices back in
+ *        it; heavy edges can only reach later buckets, so they are relaxed
+ *        once per bucket afterwards. Distances are lowered with
+ *        compare-and-swap. A small delta approaches Dijkstra, with many
+ *        short phases; a large one approaches Bellman-Ford, with much work
+ *        redone. No tentative distance is more than the longest edge past
+ *        the current bucket, so maxEdge / delta + 2 buckets, reused in a
+ *        ring, hold them all; memory does not grow with the distances.
+ * @param g The graph.
+ * @param source The source vertex.
+ * @param delta The bucket width, at least 1; defaultDelta picks one.
+ * @param threads The number of threads, the caller's included.
+ * @param dist Receives g->numVertices distances, INT_MAX where unreachable.
+ * @return The number of light phases run.
+ */
+int deltaStepping(Graph* g, int source, int delta, int threads, int* dist) {
+    int n = g->numVertices;
+    DeltaRun r = { 0 };
+    r.g = g;
+    r.dist = dist;
+    r.delta = delta;
+    int maxEdge = 0;
+    for (int e = 0; e < g->numEdges; e++) {
+        if (g->edges[e].dist > maxEdge) {
+            maxEdge = g->edges[e].dist;
+        }
+    }
+    r.numBuckets = maxEdge / delta < DELTA_BUCKETS - 2 ? maxEdge / delta + 2 : DELTA_BUCKETS;
+    r.numThreads = threads;
+    r.workers = (DeltaWorker*)calloc(threads, sizeof(DeltaWorker));
+    r.queuedIn = (int*)calloc(n > 0 ? n : 1, sizeof(int));
+    r.removedFrom = (int*)calloc(n > 0 ? n : 1, sizeof(int));
+    r.frontierStart = (int*)calloc(threads + 1, sizeof(int));
+    pthread_t* ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if (!r.workers || !r.queuedIn || !r.removedFrom || !r.frontierStart || !ids) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    for (int id = 0; id < n; id++) {
+        dist[id] = INT_MAX;
+    }
+    pthread_barrier_init(&r.barrier, NULL, threads);
+    for (int t = 0; t < threads; t++) {
+        r.workers[t].run = &r;
+        r.workers[t].index = t;
+        r.workers[t].farLowest = INT_MAX;
+        r.workers[t].buckets = (VertexList*)calloc(r.numBuckets, sizeof(VertexList));
+        if (r.workers[t].buckets == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    dist[source] = 0;
+    addToBucket(&r.workers[0], 0, source);
+
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&ids[t], NULL, deltaWorker, &r.workers[t]) != 0) {
+            fprintf(stderr, "Error: Could not start a delta-stepping thread\n");
+            exit(1);
+        }
+    }
+    deltaWorker(&r.workers[0]);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        DeltaWorker* w = &r.workers[t];
+        for (int b = 0; b < r.numBuckets; b++) {
+            free(w->buckets[b].items);
+        }
+        free(w->buckets);
+        free(w->far.items);
+        free(w->frontier.items);
+        free(w->next.items);
+        free(w->removed.items);
+    }
+    pthread_barrier_destroy(&r.barrier);
+    free(r.workers);
+    free(r.queuedIn);
+    free(r.removedFrom);
+    free(r.frontierStart);
+    free(ids);
+    return r.phases;
 }
 
 /**
@@ -201,45 +1727,208 @@ int dijkstra(Graph* g, const char* start, const char* end) {
  * @param g The graph.
  */
 void freeGraph(Graph* g) {
-    Vertex* cur_vertex = g->vertices;
-    while (cur_vertex != NULL) {
-        Edge* cur_edge = cur_vertex->edges;
-        while (cur_edge != NULL) {
-            Edge* temp_edge = cur_edge;
-            cur_edge = cur_edge->next;
-            free(temp_edge->dest);
-            free(temp_edge);
-        }
-        Vertex* temp_vertex = cur_vertex;
-        cur_vertex = cur_vertex->next;
-        free(temp_vertex->name);
-        free(temp_vertex);
+    if (g->map) {
+        munmap(g->map, g->mapSize);
     }
+    else {
+        free(g->edgeStart);
+        free(g->edges);
+        free(g->nameOffset);
+        free(g->names);
+        free(g->slots);
+    }
+    free(g->newEdgeSrc);
+    free(g->newEdges);
     free(g);
 }
 
-// Main Function
-int main(int argc, char* argv[]) {
-        //if (argc != 2) {
-        //    fprintf(stderr, "Usage: %s <input-file>\n", argv[0]);
-        //    return 1;
-        //}
+#ifndef SHORTEST_PATHS_NO_MAIN
+/**
+ * @brief Seconds on a monotonic clock, for -d.
+ * @return The current time.
+ */
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    Graph* g = initGraph();
-    readGraphFromFile(g, "input.txt"); // replace with argv[0]
+/**
+ * @brief Prints the answer to one query.
+ * @param start The name of the starting vertex.
+ * @param end The name of the ending vertex.
+ * @param dist The distance, -1 if there is no path.
+ */
+static void printAnswer(const char* start, const char* end, int dist) {
+    if (dist == -1) {
+        printf("Path not found between %s and %s.\n", start, end);
+    }
+    else {
+        printf("%d\n", dist);
+    }
+}
 
-    char start[65], end[65];
-    while (scanf("%s %s", start, end) != EOF) {
-        int dist = dijkstra(g, start, end);
-        if (dist == -1) {
-            printf("Path not found between %s and %s.\n", start, end);
+// Main Function
+int main(int argc, char* argv[]) {
+    int mode = QUERY_DIJKSTRA;
+    int landmarks = DEFAULT_LANDMARKS;
+    int debug = 0;
+    const char* preprocess = NULL;  // -p: build the hierarchy into this file and exit
+    const char* hierarchyFile = NULL;
+    const char* convert = NULL;     // -w: write the graph in binary form to this file and exit
+    const char* graphFile = NULL;
+    int threads = 1;
+    const char* source = NULL;      // -s: print the distance from here to every vertex and exit
+    int delta = 0;                  // -D: delta-stepping bucket width, 0 for defaultDelta
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            mode = QUERY_BIDIRECTIONAL;
+        }
+        else if (strcmp(argv[i], "-a") == 0) {
+            mode = QUERY_ALT;
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            landmarks = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            mode = QUERY_HIERARCHY;
+            hierarchyFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            preprocess = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            source = argv[++i];
+        }
+        else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            delta = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            convert = argv[++i];
+        }
+        else if (strcmp(argv[i], "-d") == 0) {
+            debug = 1;
+        }
+        else if (argv[i][0] != '-' && graphFile == NULL) {
+            graphFile = argv[i];
         }
         else {
-            printf("%d\n", dist);
+            fprintf(stderr, "Usage: %s [-b | -a [-l landmarks] | -c hierarchy | -p hierarchy | -w binary | "
+                "-s source [-D delta]] [-t threads] [-d] [graph]\n", argv[0]);
+            return 1;
         }
     }
 
-    freeGraph(g);
+    double started = now();
+    Graph* g;
+    Hierarchy* h = NULL;
+    if (hierarchyFile) {
+        h = readHierarchy(hierarchyFile);
+        g = h->up;  // Holds the names, so the graph itself is not needed
+        mode = QUERY_HIERARCHY;
+    }
+    else {
+        g = initGraph();
+        readGraphFromFile(g, graphFile ? graphFile : "input.txt");
+    }
+    if (convert && !hierarchyFile) {
+        double loaded = now();
+        writeGraph(g, convert);
+        if (debug) {
+            fprintf(stderr, "load: %.3f s, write: %.3f s\n", loaded - started, now() - loaded);
+            fprintf(stderr, "%d vertices, %d edges, %lld name bytes\n", g->numVertices, g->numEdges / 2, g->nameBytes);
+        }
+        freeGraph(g);
+        return 0;
+    }
+    if (preprocess && !hierarchyFile) {
+        double loaded = now();
+        h = buildHierarchy(g);
+        writeHierarchy(h, g, preprocess);
+        if (debug) {
+            fprintf(stderr, "load: %.3f s, preprocess: %.3f s\n", loaded - started, now() - loaded);
+            fprintf(stderr, "%d vertices, %d shortcuts, %d upward edges, %d core vertices\n",
+                g->numVertices, h->numShortcuts, h->up->numEdges, h->coreVertices);
+        }
+        freeHierarchy(h);
+        freeGraph(g);
+        return 0;
+    }
+    if (source && !hierarchyFile) {
+        int id = findVertex(g, source);
+        if (id == -1) {
+            fprintf(stderr, "Error: Vertex %s not found\n", source);
+            freeGraph(g);
+            return 1;
+        }
+        double loaded = now();
+        int* dist = (int*)malloc(g->numVertices * sizeof(int));
+        if (dist == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        int phases = deltaStepping(g, id, delta ? delta : defaultDelta(g), threads, dist);
+        double solved = now();
+        for (int v = 0; v < g->numVertices; v++) {
+            if (dist[v] != INT_MAX) {
+                printf("%s %d\n", vertexName(g, v), dist[v]);
+            }
+        }
+        if (debug) {
+            fprintf(stderr, "load: %.3f s, delta-stepping: %.3f s\n", loaded - started, solved - loaded);
+            fprintf(stderr, "delta %d, %d light phases, %d threads\n",
+                delta ? delta : defaultDelta(g), phases, threads);
+        }
+        free(dist);
+        freeGraph(g);
+        return 0;
+    }
+    QueryEngine* q = initQueryEngine(g, mode);
+    q->hierarchy = h;
+    if (mode == QUERY_ALT && g->numVertices > 0) {
+        chooseLandmarks(q, landmarks);
+    }
+    double loaded = now();
+
+    if (threads > 1) {
+        // Read a batch, answer it on every thread, print it in input order
+        QueryPool* pool = initQueryPool(q, threads);
+        int count;
+        do {
+            count = 0;
+            while (count < QUERY_BATCH && scanf("%64s %64s", pool->starts[count], pool->ends[count]) == 2) {
+                count++;
+            }
+            answerBatch(pool, count);
+            for (int i = 0; i < count; i++) {
+                printAnswer(pool->starts[i], pool->ends[i], pool->answers[i]);
+            }
+        } while (count == QUERY_BATCH);
+        freeQueryPool(pool);
+    }
+    else {
+        char start[65], end[65];
+        while (scanf("%64s %64s", start, end) == 2) {
+            printAnswer(start, end, shortestDistance(q, start, end));
+        }
+    }
+
+    if (debug) {
+        fprintf(stderr, "load: %.3f s, queries: %.3f s\n", loaded - started, now() - loaded);
+        fprintf(stderr, "%ld queries, %ld vertices settled, %.1f per query\n",
+            q->queries, q->settled, q->queries ? (double)q->settled / q->queries : 0.0);
+    }
+    freeQueryEngine(q);
+    if (h) {
+        freeHierarchy(h);  // And g with it
+    }
+    else {
+        freeGraph(g);
+    }
 
     return 0;
 }
+#endif
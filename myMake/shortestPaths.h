@@ -0,0 +1,188 @@
+/**
+ * @file shortestPaths.h
+ * @brief Graph, search and query engine types of shortestPaths.c, shared
+ *        with the benchmarks in bench/paths_bench.c and bench/sssp_bench.c.
+ * @author Ahmad Gaber
+ */
+#ifndef SHORTEST_PATHS_H
+#define SHORTEST_PATHS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct Edge {
+    int dest;            // Index of the destination vertex
+    int dist;
+} Edge;
+
+// A graph in compressed sparse row form. Built in memory from a text file,
+// or mapped from a binary one, in which case every array points into the
+// mapping and nothing is copied; a mapped graph is read-only.
+typedef struct Graph {
+    int numVertices;
+    int numEdges;        // Entries in edges; an undirected edge has one at each end
+    int* edgeStart;      // Edges of v are edges[edgeStart[v]] .. edges[edgeStart[v + 1] - 1]
+    Edge* edges;
+    int* nameOffset;     // Name of v at names + nameOffset[v]
+    char* names;         // Every name once, NUL-terminated
+    long long nameBytes;
+    int* slots;          // Name index, open addressing over vertex ids, -1 when empty
+    int slotCapacity;
+    int vertexCapacity;  // Room in nameOffset while building
+    long long nameCapacity;
+    int* newEdgeSrc;     // Edges added since the graph was created, until finalizeGraph
+    Edge* newEdges;
+    int numNewEdges;
+    int newEdgeCapacity;
+    void* map;           // The mapped file, NULL when the arrays are on the heap
+    size_t mapSize;
+} Graph;
+
+// Start of a binary graph or hierarchy file, followed by edgeStart, the
+// edges, nameOffset, the name index and the names
+typedef struct GraphFileHeader {
+    char magic[8];       // GRAPH_MAGIC or HIERARCHY_MAGIC
+    int numVertices;
+    int numEdges;
+    int slotCapacity;
+    int reserved;
+    long long nameBytes;
+} GraphFileHeader;
+
+// Sources whose searches are kept between queries
+#define CACHED_SOURCES 4
+
+// heapIndex of a vertex whose distance is final
+#define SETTLED -2
+
+// Landmarks picked for -a unless -l says otherwise
+#define DEFAULT_LANDMARKS 8
+
+// How a QueryEngine answers a query
+#define QUERY_DIJKSTRA 0
+#define QUERY_BIDIRECTIONAL 1
+#define QUERY_ALT 2
+#define QUERY_HIERARCHY 3
+
+// Vertices a witness search may settle before giving up and adding the shortcut
+#define WITNESS_SETTLE_LIMIT 500
+
+// Average degree of the uncontracted vertices past which buildHierarchy
+// stops contracting, unless fewer than one in CORE_MIN_SHARE vertices is left
+#define CORE_DEGREE_LIMIT 12
+#define CORE_MIN_SHARE 100
+
+// Queries read and answered together under -t, and how many a thread takes at a time
+#define QUERY_BATCH 4096
+#define QUERY_CHUNK 16
+
+// Frontier vertices a delta-stepping thread takes at a time
+#define DELTA_CHUNK 64
+
+// Most buckets a delta-stepping thread keeps; vertices further ahead wait in its far list
+#define DELTA_BUCKETS 4096
+
+// First bytes of a binary graph and of a contraction hierarchy file
+#define GRAPH_MAGIC "SPGR0001"
+#define HIERARCHY_MAGIC "SPCH0002"
+
+// A Dijkstra search from one source, kept so that it can be resumed. Every
+// vertex it has popped is settled for good, so a later query from the same
+// source either reads its answer or continues from the frontier.
+typedef struct Search {
+    int source;          // -1 while the entry is unused
+    int* dist;           // Tentative distance, INT_MAX when not reached
+    int* key;            // Heap order: dist, plus the landmark bound in A*
+    int* heapIndex;      // Position in the heap, -1 when not queued, SETTLED when final
+    int* heap;           // Frontier, vertex ids ordered by key
+    int heapSize;
+    int* touched;        // Vertices whose dist was set, so a reset only visits those
+    int numTouched;
+    long lastUsed;       // Query number of the last use, for LRU eviction
+} Search;
+
+// A contraction hierarchy. Vertices were contracted one by one, cheapest
+// first, and each contraction added shortcuts between its remaining
+// neighbours wherever the path through it was the only shortest one. Only
+// the edges going up, from a vertex to the ones contracted after it, are
+// kept: every shortest path has an equally short one that climbs and then
+// descends, so a query meets in the middle with two upward searches. If
+// contraction stopped early, the core vertices left at the top keep their
+// edges to each other both ways.
+typedef struct Hierarchy {
+    Graph* up;           // Upward edges, with the names when read from a file
+    int numShortcuts;    // Edges added by contraction, 0 for a hierarchy read from disk
+    int coreVertices;    // Left uncontracted at the top, 0 for a hierarchy read from disk
+} Hierarchy;
+
+// Everything a query writes lives in its engine, so threads answer
+// queries at the same time with an engine each over one read-only graph.
+typedef struct QueryEngine {
+    Graph* g;
+    int mode;            // QUERY_DIJKSTRA, QUERY_BIDIRECTIONAL, QUERY_ALT or QUERY_HIERARCHY
+    Hierarchy* hierarchy;  // Searched by QUERY_HIERARCHY, owned by the caller
+    Search searches[CACHED_SOURCES];
+    Search scratch[2];   // Point-to-point searches, forward and backward
+    int* landmarkDist;   // Distance from landmark i to vertex v at [v * numLandmarks + i]
+    int numLandmarks;
+    int sharesLandmarks; // landmarkDist belongs to the engine this one was shared from
+    long queries;
+    long settled;        // Vertices settled over all queries
+} QueryEngine;
+
+// Worker threads that answer a batch of queries together. The caller
+// fills starts and ends, and answerBatch returns once every answer is in.
+typedef struct QueryPool {
+    QueryEngine** engines;  // One per thread, engines[0] is the caller's own
+    int numThreads;
+    pthread_t* threads;
+    char (*starts)[65];  // QUERY_BATCH names each
+    char (*ends)[65];
+    int* answers;
+    int count;
+    int next;            // First query no thread has taken yet
+    int busy;            // Workers not done with the current batch
+    long batch;          // Number of the current batch, for the workers to notice a new one
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // A new batch, or closing
+    pthread_cond_t idle; // busy dropped to 0
+} QueryPool;
+
+// Function Prototypes
+Graph* initGraph();
+int addVertex(Graph* g, const char* name);
+const char* vertexName(Graph* g, int id);
+int findVertex(Graph* g, const char* name);
+void addEdge(Graph* g, int src, int dest, int dist);
+void finalizeGraph(Graph* g);
+void readGraphFromFile(Graph* g, const char* filename);
+void writeGraph(Graph* g, const char* filename);
+QueryEngine* initQueryEngine(Graph* g, int mode);
+void chooseLandmarks(QueryEngine* q, int count);
+Search* findSearch(QueryEngine* q, int start);
+int popMinDistVertex(Search* s);
+int dijkstra(QueryEngine* q, int start, int end);
+int bidirectionalDijkstra(QueryEngine* q, int start, int end);
+int altSearch(QueryEngine* q, int start, int end);
+int hierarchySearch(QueryEngine* q, int start, int end);
+int shortestDistance(QueryEngine* q, const char* start, const char* end);
+void freeQueryEngine(QueryEngine* q);
+QueryEngine* shareQueryEngine(QueryEngine* q);
+QueryPool* initQueryPool(QueryEngine* q, int threads);
+void answerBatch(QueryPool* p, int count);
+void freeQueryPool(QueryPool* p);
+void freeGraph(Graph* g);
+Hierarchy* buildHierarchy(Graph* g);
+void writeHierarchy(Hierarchy* h, Graph* g, const char* filename);
+Hierarchy* readHierarchy(const char* filename);
+void freeHierarchy(Hierarchy* h);
+void dijkstraAll(Graph* g, int source, int* dist);
+int defaultDelta(Graph* g);
+int deltaStepping(Graph* g, int source, int delta, int threads, int* dist);
+
+#endif
@@ -0,0 +1,241 @@
+// signatures.c
+// Content-signature rebuild mode (-H). Instead of comparing mtimes, every
+// target records a signature made of its recipe text and the content
+// hashes of its prerequisites, and is rebuilt only when that changes.
+//
+// The database lives next to the makefile (<makefile>.sigdb) and is an
+// open-addressing hash table mapped straight into memory, so opening it
+// touches the header page and each lookup touches about one more page no
+// matter how many entries it holds. Slots hold two kinds of records:
+//   file records:   path -> content hash, plus the mtime and size it was taken at
+//   target records: target -> signature of its last successful build
+//
+// -n and -q open it read-only: nothing runs, so nothing may be recorded
+// that would change what the next real build decides.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "graph.h"
+
+#define SIGDB_MAGIC "MYMKSIG1"
+#define SIGDB_INITIAL_SLOTS 1024
+
+typedef struct SigHeader {
+    char magic[8];
+    uint64_t capacity;  // Number of slots, always a power of two
+    uint64_t count;     // Slots in use
+    uint64_t reserved;
+} SigHeader;
+
+typedef struct SigSlot {
+    uint64_t key;       // 0 marks an empty slot
+    uint64_t hash;
+    int64_t mtimeNs;    // Only used by file records
+    int64_t size;
+} SigSlot;
+
+int useSignatures = 0;
+
+static int sigFd = -1;
+static SigHeader* sigHeader = NULL;   // NULL when opened read-only and there is no valid database
+static size_t sigMapSize = 0;
+static int sigReadOnly = 0;
+
+static SigSlot* sigSlots() {
+    return (SigSlot*)(sigHeader + 1);
+}
+
+static size_t sigFileSize(uint64_t capacity) {
+    return sizeof(SigHeader) + capacity * sizeof(SigSlot);
+}
+
+static void mapSignatureFile(size_t size) {
+    sigMapSize = size;
+    sigHeader = (SigHeader*)mmap(NULL, size, sigReadOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, sigFd, 0);
+    if (sigHeader == MAP_FAILED) {
+        fprintf(stderr, "Could not map the signature database.\n");
+        sigHeader = NULL;
+        exitWithError();
+    }
+}
+
+static void resetSignatureFile(uint64_t capacity) {
+    // Truncating to zero first guarantees the new slots read back as empty
+    if (ftruncate(sigFd, 0) != 0 || ftruncate(sigFd, sigFileSize(capacity)) != 0) {
+        fprintf(stderr, "Could not resize the signature database.\n");
+        exitWithError();
+    }
+    mapSignatureFile(sigFileSize(capacity));
+    memcpy(sigHeader->magic, SIGDB_MAGIC, 8);
+    sigHeader->capacity = capacity;
+    sigHeader->count = 0;
+}
+
+void openSignatureDatabase(const char* makefile, int readOnly) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.sigdb", makefile);
+
+    sigReadOnly = readOnly;
+    sigFd = readOnly ? open(path, O_RDONLY) : open(path, O_RDWR | O_CREAT, 0644);
+    if (sigFd < 0 && readOnly) {
+        return;  // Nothing recorded yet, every lookup misses
+    }
+    if (sigFd < 0) {
+        fprintf(stderr, "Could not open signature database %s.\n", path);
+        exitWithError();
+    }
+
+    struct stat info;
+    fstat(sigFd, &info);
+    if ((size_t)info.st_size >= sizeof(SigHeader)) {
+        mapSignatureFile(info.st_size);
+        uint64_t capacity = sigHeader->capacity;
+        if (memcmp(sigHeader->magic, SIGDB_MAGIC, 8) == 0 && capacity != 0
+            && (capacity & (capacity - 1)) == 0 && sigFileSize(capacity) == (size_t)info.st_size) {
+            return;  // Valid database, use it as is
+        }
+        munmap(sigHeader, sigMapSize);
+        sigHeader = NULL;
+    }
+    // Missing or damaged, start over with an empty table
+    if (!readOnly) {
+        resetSignatureFile(SIGDB_INITIAL_SLOTS);
+    }
+}
+
+void closeSignatureDatabase() {
+    if (sigHeader != NULL) {
+        munmap(sigHeader, sigMapSize);
+        sigHeader = NULL;
+    }
+    if (sigFd >= 0) {
+        close(sigFd);
+        sigFd = -1;
+    }
+}
+
+static SigSlot* findSlot(SigSlot* slots, uint64_t capacity, uint64_t key) {
+    uint64_t i = key & (capacity - 1);
+    while (slots[i].key != 0 && slots[i].key != key) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+static void growSignatureDatabase() {
+    uint64_t oldCapacity = sigHeader->capacity;
+    SigSlot* oldSlots = (SigSlot*)malloc(oldCapacity * sizeof(SigSlot));
+    if (!oldSlots) {
+        fprintf(stderr, "Failed to allocate memory for the graph.\n");
+        exitWithError();
+    }
+    memcpy(oldSlots, sigSlots(), oldCapacity * sizeof(SigSlot));
+
+    munmap(sigHeader, sigMapSize);
+    resetSignatureFile(oldCapacity * 2);
+    for (uint64_t i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i].key != 0) {
+            *findSlot(sigSlots(), sigHeader->capacity, oldSlots[i].key) = oldSlots[i];
+            sigHeader->count++;
+        }
+    }
+    free(oldSlots);
+}
+
+static SigSlot* lookupRecord(uint64_t key) {
+    if (sigHeader == NULL) {
+        return NULL;
+    }
+    SigSlot* slot = findSlot(sigSlots(), sigHeader->capacity, key);
+    return slot->key != 0 ? slot : NULL;
+}
+
+static void storeRecord(uint64_t key, uint64_t hash, int64_t mtimeNs, int64_t size) {
+    if (sigReadOnly) {
+        return;
+    }
+    if ((sigHeader->count + 1) * 2 > sigHeader->capacity) {
+        growSignatureDatabase();  // Keep the table at most half full
+    }
+    SigSlot* slot = findSlot(sigSlots(), sigHeader->capacity, key);
+    if (slot->key == 0) {
+        sigHeader->count++;
+    }
+    slot->key = key;
+    slot->hash = hash;
+    slot->mtimeNs = mtimeNs;
+    slot->size = size;
+}
+
+static uint64_t recordKey(const char* name, uint64_t kind) {
+    uint64_t key = hashBytes(name, strlen(name), kind);
+    return key != 0 ? key : 1;
+}
+
+// Content hash of a file, recomputed only when its mtime or size moved
+// since the hash was recorded. Missing files hash to 0.
+uint64_t fileSignature(const char* path) {
+    struct stat info;
+    if (cachedStat(path, &info) != 0) {
+        return 0;
+    }
+
+    uint64_t key = recordKey(path, 1);
+    int64_t mtimeNs = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    SigSlot* record = lookupRecord(key);
+    if (record != NULL && record->mtimeNs == mtimeNs && record->size == (int64_t)info.st_size) {
+        return record->hash;
+    }
+
+    uint64_t hash = hashBytes("", 0, 0);
+    if (info.st_size > 0) {
+        int fd = open(path, O_RDONLY);
+        void* data = fd >= 0 ? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "Could not read %s to hash it.\n", path);
+            if (fd >= 0) {
+                close(fd);
+            }
+            exitWithError();
+        }
+        hash = hashBytes(data, info.st_size, 0);
+        munmap(data, info.st_size);
+        close(fd);
+    }
+    storeRecord(key, hash, mtimeNs, info.st_size);
+    return hash;
+}
+
+// Signature of the node for this build: its name, its recipe and the
+// content of its prerequisites. Also kept in node->signature.
+uint64_t computeSignature(Graph* graph, int target) {
+    GraphNode* node = &graph->nodes[target];
+    uint64_t signature = hashBytes(node->name, strlen(node->name), 3);
+    for (CommandNode* command = node->commands; command != NULL; command = command->next) {
+        signature = hashBytes(command->command, strlen(command->command) + 1, signature);
+    }
+    for (int e = graph->prereqStart[target]; e < graph->prereqStart[target + 1]; e++) {
+        uint64_t content = fileSignature(graph->nodes[graph->prereqs[e]].name);
+        signature = hashBytes(&content, sizeof(content), signature);
+    }
+    node->signature = signature;
+    return signature;
+}
+
+// Computes the node's signature for this build and compares it with the one
+// recorded after its last build. Returns 1 if it changed, 0 if it is the
+// same, and -1 if the target was never built in this mode.
+int signatureChanged(Graph* graph, int target) {
+    GraphNode* node = &graph->nodes[target];
+    uint64_t signature = computeSignature(graph, target);
+
+    SigSlot* record = lookupRecord(recordKey(node->name, 2));
+    if (record == NULL) {
+        return -1;
+    }
+    return record->hash != signature;
+}
+
+void recordSignature(GraphNode* node) {
+    storeRecord(recordKey(node->name, 2), node->signature, 0, 0);
+}
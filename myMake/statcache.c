@@ -0,0 +1,58 @@
+// statcache.c
+// Per-run cache of stat() results keyed by path. A file is stat'd the first
+// time it is asked about and the answer is reused until the recipe that
+// produces it runs and invalidates the entry.
+#include "graph.h"
+
+typedef struct StatEntry {
+    char* path;
+    struct stat info;
+    int exists;
+    int valid;  // 0 once the file may have changed
+} StatEntry;
+
+static HashMap statCache;
+long statLookups = 0;  // Calls to cachedStat
+long statCalls = 0;    // Calls that actually reached stat()
+
+int cachedStat(const char* path, struct stat* info) {
+    statLookups++;
+    StatEntry* entry = (StatEntry*)hashMapGet(&statCache, path);
+    if (entry == NULL) {
+        entry = (StatEntry*)malloc(sizeof(StatEntry));
+        if (!entry || !(entry->path = strdup(path))) {
+            fprintf(stderr, "Failed to allocate memory for the graph.\n");
+            exitWithError();
+        }
+        entry->valid = 0;
+        hashMapPut(&statCache, entry->path, entry);
+    }
+    if (!entry->valid) {
+        statCalls++;
+        entry->exists = stat(path, &entry->info) == 0;
+        entry->valid = 1;
+    }
+    if (!entry->exists) {
+        return -1;
+    }
+    *info = entry->info;
+    return 0;
+}
+
+void invalidateStat(const char* path) {
+    StatEntry* entry = (StatEntry*)hashMapGet(&statCache, path);
+    if (entry != NULL) {
+        entry->valid = 0;
+    }
+}
+
+void freeStatCache() {
+    for (size_t i = 0; i < statCache.capacity; i++) {
+        StatEntry* entry = (StatEntry*)statCache.entries[i].value;
+        if (statCache.entries[i].key != NULL) {
+            free(entry->path);
+            free(entry);
+        }
+    }
+    hashMapFree(&statCache);
+}
@@ -0,0 +1,117 @@
+// trace.c
+// Build timeline for --trace=FILE. Spans are appended to an in-memory array
+// while the build runs and written once, at exit, as Chrome trace-event JSON
+// (load it in chrome://tracing or ui.perfetto.dev). Recording a span is a
+// clock read, a struct copy and a copy of its name into an arena, so tracing
+// adds next to nothing to a build.
+//
+// Targets are stored as pointers, not copies, so writeTrace has to run before
+// the graph and the makefile mapping are released. Names are copied: an
+// expanded recipe line lives in a buffer that the next expansion reuses.
+#include <time.h>
+#include "graph.h"
+
+typedef struct TraceEvent {
+    const char* name;
+    const char* category;
+    const char* target;   // NULL if the span does not belong to a target
+    int64_t startNs;
+    int64_t endNs;
+    int lane;             // Shown as the thread id, one lane per job slot
+    int status;           // Exit status of a recipe line, TRACE_NO_STATUS otherwise
+} TraceEvent;
+
+static const char* tracePath = NULL;
+static TraceEvent* events = NULL;
+static size_t numEvents = 0, eventCapacity = 0;
+static int64_t traceStart = 0;
+static Arena traceNames;
+
+int64_t traceNow() {
+    if (tracePath == NULL) {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - traceStart;
+}
+
+void startTrace(const char* path) {
+    tracePath = path;
+    traceStart = traceNow();
+}
+
+void traceSpan(const char* name, const char* category, const char* target,
+               int64_t startNs, int lane, int status) {
+    if (tracePath == NULL) {
+        return;
+    }
+    if (numEvents == eventCapacity) {
+        eventCapacity = eventCapacity ? eventCapacity * 2 : 1024;
+        TraceEvent* grown = (TraceEvent*)realloc(events, eventCapacity * sizeof(TraceEvent));
+        if (!grown) {
+            return;  // Losing the trace is better than failing the build
+        }
+        events = grown;
+    }
+    TraceEvent* event = &events[numEvents++];
+    event->name = arenaStrdup(&traceNames, name);
+    event->category = category;
+    event->target = target;
+    event->startNs = startNs;
+    event->endNs = traceNow();
+    event->lane = lane;
+    event->status = status;
+}
+
+static void writeJsonString(FILE* file, const char* s) {
+    fputc('"', file);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        }
+        else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        }
+        else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+void writeTrace() {
+    if (tracePath == NULL) {
+        return;
+    }
+    FILE* file = fopen(tracePath, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open trace file %s for writing.\n", tracePath);
+    }
+    else {
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (size_t i = 0; i < numEvents; i++) {
+            TraceEvent* event = &events[i];
+            fprintf(file, "{\"name\":");
+            writeJsonString(file, event->name);
+            fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{",
+                event->category, event->startNs / 1e3, (event->endNs - event->startNs) / 1e3, event->lane);
+            if (event->target) {
+                fprintf(file, "\"target\":");
+                writeJsonString(file, event->target);
+            }
+            if (event->status != TRACE_NO_STATUS) {
+                fprintf(file, "%s\"status\":%d", event->target ? "," : "", event->status);
+            }
+            fprintf(file, "}}%s\n", i + 1 < numEvents ? "," : "");
+        }
+        fprintf(file, "]}\n");
+        fclose(file);
+    }
+    free(events);
+    arenaRelease(&traceNames);
+    events = NULL;
+    numEvents = eventCapacity = 0;
+    tracePath = NULL;
+}
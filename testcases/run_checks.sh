@@ -0,0 +1,225 @@
+#!/bin/bash
+# run_checks.sh
+# Scripted checks for the fixtures that need more than a makefile: source
+# files, flags or several runs in a row. Each check copies its
+# test_mymake_NN_target file as myMakefile into an empty directory, sets up
+# the files around it, runs mymake there and compares the output, the
+# exit status and what the recipes wrote with the expected ones.
+#
+#   run_checks.sh path/to/mymake
+#
+# Exits with status 1 if any check failed. Modification times have a
+# resolution of one second, hence the sleeps before files are touched.
+
+MYMAKE=$(realpath "$1")
+FIXTURES=$(dirname "$(realpath "$0")")
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+checks=0
+failures=0
+
+# setup <fixture>: a fresh directory holding the fixture as myMakefile
+setup() {
+    rm -rf "$WORKDIR/run"
+    mkdir "$WORKDIR/run"
+    cp "$FIXTURES/$1" "$WORKDIR/run/myMakefile"
+    cd "$WORKDIR/run" || exit 1
+}
+
+# check <description> <status> <output> [mymake arguments...]
+check() {
+    local description=$1 status=$2 expected=$3
+    shift 3
+    local output
+    output=$("$MYMAKE" "$@" 2>&1)
+    local actual=$?
+    checks=$((checks + 1))
+    if [ "$actual" != "$status" ] || [ "$output" != "$expected" ]; then
+        failures=$((failures + 1))
+        echo "FAIL: $description"
+        echo "  expected status $status, output:"
+        echo "$expected" | sed 's/^/    /'
+        echo "  got status $actual, output:"
+        echo "$output" | sed 's/^/    /'
+    fi
+}
+
+# check_file <description> <content> <file>
+check_file() {
+    checks=$((checks + 1))
+    if [ "$(cat "$3" 2>&1)" != "$2" ]; then
+        failures=$((failures + 1))
+        echo "FAIL: $1"
+        echo "  expected $3 to hold: $2"
+        echo "  got: $(cat "$3" 2>&1)"
+    fi
+}
+
+# -H: a touch alone rebuilds nothing, an edit that keeps the old mtime is
+# caught, and a changed recipe rebuilds only its own target
+setup test_mymake_40_all
+echo one > lib.c
+sleep 1
+check "-H: first build" 0 "cp lib.c lib.o
+touch all" -H
+check "-H: up to date" 0 "" -H
+sleep 1
+touch lib.c
+check "-H: a touch rebuilds nothing" 0 "" -H
+echo two > lib.c
+check "-H: an edit rebuilds" 0 "cp lib.c lib.o
+touch all" -H
+echo three > lib.c
+touch -r myMakefile lib.c
+check "-H: without -H an edit with an old mtime is missed" 0 ""
+check "-H: an edit with an old mtime rebuilds" 0 "cp lib.c lib.o
+touch all" -H
+sed -i 's/cp lib.c lib.o/cat lib.c > lib.o/' myMakefile
+check "-H: a changed recipe rebuilds its target only" 0 "cat lib.c > lib.o" -H
+
+# -n and -q with -H record nothing, so they can't change what the next
+# build decides
+echo four > lib.c
+cksum < myMakefile.sigdb > before.sum
+check "-H: -n after an edit" 0 "cat lib.c > lib.o
+touch all" -H -n
+check "-H: -q after an edit" 1 "" -H -q
+cksum < myMakefile.sigdb > after.sum
+check_file "-H: -n and -q leave the database alone" "$(cat before.sum)" after.sum
+check "-H: the edit still rebuilds" 0 "cat lib.c > lib.o
+touch all" -H
+rm myMakefile.sigdb
+check "-H: -n with no database" 0 "" -H -n
+echo five > lib.c
+touch -r myMakefile lib.c
+check "-H: after -n the first -H build still trusts the mtimes" 0 "" -H
+
+# -n prints the recipes that would run, in build order, and runs none of
+# them. -q prints nothing and exits 0 if up to date, 1 if not, 2 on error
+setup test_mymake_41_all
+touch lib.c main.c
+sleep 1
+check "-n: everything stale" 0 "touch lib.o
+touch main.o
+touch all" -n
+check "-q: stale, and -n ran nothing" 1 "" -q
+check "-q: missing prerequisite" 2 "File not found and not a target: nosuchfile.c" -q broken
+check "-q: unknown target" 2 "Target 'nonexistent' not found in the graph." -q nonexistent
+check "build" 0 "touch lib.o
+touch main.o
+touch all"
+check "-q: up to date" 0 "" -q
+check "-n: up to date" 0 "" -n
+sleep 1
+touch lib.c
+check "-n: a changed source" 0 "touch lib.o
+touch main.o
+touch all" -n
+check "-q: a changed source" 1 "" -q
+setup test_mymake_42_all
+check "-q: invalid makefile" 2 "No ':' on definition line: all x y
+Illegal File Format" -q
+
+# --server: the client lists the stale targets in build order, --build
+# runs them in the server, and a change inotify reports makes what depends
+# on it stale again
+setup test_mymake_43_all
+touch lib.c
+sleep 1
+"$MYMAKE" --server > server.log 2>&1 &
+server=$!
+for i in $(seq 50); do
+    [ -S myMakefile.sock ] && break
+    sleep 0.1
+done
+check "server: stale targets" 1 "lib.o
+all" --client
+check "server: build" 0 "touch lib.o
+touch all" --client --build
+check "server: up to date" 0 "" --client
+sleep 1
+touch lib.c
+sleep 0.5
+check "server: a touched source" 1 "lib.o
+all" --client
+check "server: unknown target" 2 "Target 'nope' not found in the graph." --client nope
+kill $server
+wait $server 2>/dev/null
+
+# Artifact cache: outputs deleted after a build come back from the cache
+# without running a recipe, even after a clean. Writing to a restored
+# output doesn't change the cached copy. With a 1 MB limit, storing
+# big2 evicts the older big1
+setup test_mymake_44_all
+echo hello > in.txt
+sleep 1
+check "cache: first build stores" 0 "cp in.txt out.txt
+touch all" --cache=cache
+rm out.txt all
+check "cache: deleted outputs are restored, no recipe runs" 0 "Restored out.txt from the artifact cache
+Restored all from the artifact cache" --cache=cache
+check_file "cache: restored content" "hello" out.txt
+check "cache: up to date after a restore" 0 "" --cache=cache
+echo appended >> out.txt
+rm out.txt all
+check "cache: restored after an in-place edit" 0 "Restored out.txt from the artifact cache
+Restored all from the artifact cache" --cache=cache
+check_file "cache: an in-place edit of a restored output leaves the entry alone" "hello" out.txt
+rm out.txt all
+check "cache: without --cache the recipes run" 0 "cp in.txt out.txt
+touch all"
+check "cache: big1 stored" 0 "head -c 600000 /dev/zero > big1" --cache=cache --cache-size=1 big1
+sleep 1
+check "cache: big2 stored" 0 "head -c 600000 /dev/zero > big2" --cache=cache --cache-size=1 big2
+rm big1 big2
+check "cache: the newest entry survives eviction" 0 "Restored big2 from the artifact cache" --cache=cache --cache-size=1 big2
+check "cache: the oldest entry was evicted" 0 "head -c 600000 /dev/zero > big1" --cache=cache --cache-size=1 big1
+
+# Depfiles: escaped names are read as files, a header that no longer
+# exists is ignored, and a header only another target depends on changes
+# nothing
+setup test_mymake_45_app.bin
+touch app.c "my header.h" "odd#1.h" other.h zzz.h
+printf 'app.o: app.c my\\ header.h odd\\#1.h gone.h \\\n other.h\nother.o: zzz.h\nmy\\ header.h:\n' > app.d
+sleep 1
+check "depfile: first build" 0 "touch app.o
+touch app.bin" app.bin
+check "depfile: up to date" 0 "" app.bin
+sleep 1
+touch zzz.h
+check "depfile: other target's rule is not applied" 0 "" app.bin
+touch "odd#1.h"
+check "depfile: escaped # header rebuilds" 0 "touch app.o
+touch app.bin" app.bin
+sleep 1
+touch "my header.h"
+check "depfile: escaped space header rebuilds" 0 "touch app.o
+touch app.bin" app.bin
+sleep 1
+touch other.h
+check "depfile: header after a continuation rebuilds" 0 "touch app.o
+touch app.bin" app.bin
+printf 'other.o: zzz.h\n' > app.d
+sleep 1
+touch zzz.h
+check "depfile: a depfile naming another target adds nothing" 0 "" app.bin
+
+# Pattern rules: main.o comes from %.o: %.c, util.o has its own rule, which
+# wins over the pattern, and missing.o matches the pattern but has no source
+setup test_mymake_46_prog
+touch main.c util.c util.h defs.h
+sleep 1
+check "pattern: first build" 0 "echo cc main.c -o main.o > main.o
+echo explicit util.o from util.c util.h > util.o
+echo link main.o util.o -o prog > prog" prog
+check_file "pattern: \$< and \$@ expanded" "cc main.c -o main.o" main.o
+check_file "pattern: \$^ expanded" "link main.o util.o -o prog" prog
+check "pattern: up to date" 0 "" prog
+sleep 1
+touch defs.h
+check "pattern: prerequisite of the pattern rebuilds only its match" 0 "echo cc main.c -o main.o > main.o
+echo link main.o util.o -o prog > prog" prog
+check "pattern: no match" 1 "File not found and not a target: missing.o" nothing
+
+echo "$checks checks, $failures failed"
+[ "$failures" -eq 0 ]